@@ -0,0 +1,255 @@
+/*! \file
+ * The embedding API declared in subpython.h.  Internally an error longjmp()s
+ * to the session's error_jmp; every entry point that can raise one catches
+ * it here and turns it into a status.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "subpython.h"
+#include "interp.h"
+#include "dict.h"
+#include "gc.h"
+#include "list.h"
+#include "snapshot.h"
+#include "symtab.h"
+
+/*! True if `value` is a float or a live table entry. */
+static bool valid_handle(Interp *interp, SubpythonValue value) {
+    if (is_float_ref(value)) {
+        return true;
+    }
+
+    return value >= 0 && value < interp->num_refs &&
+           interp->ref_table[value].occupied &&
+           interp->ref_table[value].type != VAL_EMPTY;
+}
+
+/*! Checks that `value` is a live value of the given type. */
+static SubpythonStatus check_type(Interp *interp, SubpythonValue value,
+                                  enum Type type) {
+    if (!valid_handle(interp, value)) {
+        return SUBPYTHON_INVALID_HANDLE;
+    }
+
+    return ref_type(interp, value) == type ? SUBPYTHON_OK
+                                           : SUBPYTHON_TYPE_ERROR;
+}
+
+Subpython *subpython_create(FILE *out) {
+    return interp_create(out);
+}
+
+void subpython_destroy(Subpython *session) {
+    interp_destroy(session);
+}
+
+SubpythonStatus subpython_save(Subpython *session, const char *path) {
+    if (!snapshot_save(session, path)) {
+        snprintf(session->error_message, ERROR_MESSAGE_SIZE, "%s: %s", path,
+                 strerror(errno));
+        return SUBPYTHON_ERROR;
+    }
+
+    return SUBPYTHON_OK;
+}
+
+Subpython *subpython_restore(const char *path, FILE *out) {
+    return snapshot_load(path, out);
+}
+
+SubpythonStatus subpython_eval(Subpython *session, const char *source) {
+    long errors = session->errors;
+
+    for (const char *next = source; *next != '\0'; ) {
+        next = interp_run_statement(session, next, false);
+
+        if (session->errors != errors) {
+            return SUBPYTHON_ERROR;
+        }
+    }
+
+    return SUBPYTHON_OK;
+}
+
+const char *subpython_error(Subpython *session) {
+    return session->error_message;
+}
+
+SubpythonStatus subpython_global(Subpython *session, const char *name,
+                                 SubpythonValue *value) {
+    /* A lookup that doesn't create can't raise, so a missing name leaves the
+     * session's error state alone. */
+    int slot = resolve_global(session, name, false);
+
+    if (slot == -1 || session->global_vars[slot].ref == -1) {
+        return SUBPYTHON_NOT_FOUND;
+    }
+
+    *value = session->global_vars[slot].ref;
+    return SUBPYTHON_OK;
+}
+
+SubpythonType subpython_type(Subpython *session, SubpythonValue value) {
+    if (!valid_handle(session, value)) {
+        return SUBPYTHON_NONE;
+    }
+
+    switch (ref_type(session, value)) {
+        case VAL_FLOAT:
+            return SUBPYTHON_FLOAT;
+        case VAL_STRING:
+            return SUBPYTHON_STRING;
+        case VAL_LIST:
+            return SUBPYTHON_LIST;
+        case VAL_DICT:
+            return SUBPYTHON_DICT;
+        case VAL_EMPTY:
+        default:
+            return SUBPYTHON_NONE;
+    }
+}
+
+SubpythonStatus subpython_float(Subpython *session, SubpythonValue value,
+                                float *f) {
+    SubpythonStatus status = check_type(session, value, VAL_FLOAT);
+
+    if (status == SUBPYTHON_OK) {
+        *f = ref_float(value);
+    }
+
+    return status;
+}
+
+SubpythonStatus subpython_string(Subpython *session, SubpythonValue value,
+                                 char *buf, size_t size, size_t *length) {
+    SubpythonStatus status = check_type(session, value, VAL_STRING);
+
+    if (status != SUBPYTHON_OK) {
+        return status;
+    }
+
+    const char *str = deref(session, value)->string_value;
+    size_t len = strlen(str);
+
+    if (size != 0) {
+        size_t copied = len < size - 1 ? len : size - 1;
+
+        memcpy(buf, str, copied);
+        buf[copied] = '\0';
+    }
+
+    if (length != NULL) {
+        *length = len;
+    }
+
+    return SUBPYTHON_OK;
+}
+
+SubpythonStatus subpython_list_length(Subpython *session, SubpythonValue list,
+                                      size_t *length) {
+    SubpythonStatus status = check_type(session, list, VAL_LIST);
+
+    if (status == SUBPYTHON_OK) {
+        *length = deref(session, list)->list->length;
+    }
+
+    return status;
+}
+
+SubpythonStatus subpython_list_get(Subpython *session, SubpythonValue list,
+                                   size_t index, SubpythonValue *item) {
+    SubpythonStatus status = check_type(session, list, VAL_LIST);
+
+    if (status != SUBPYTHON_OK) {
+        return status;
+    }
+
+    ListArray *array = deref(session, list)->list;
+
+    if (index >= (size_t) array->length) {
+        return SUBPYTHON_INDEX_ERROR;
+    }
+
+    *item = array->items[index];
+    return SUBPYTHON_OK;
+}
+
+SubpythonStatus subpython_dict_length(Subpython *session, SubpythonValue dict,
+                                      size_t *length) {
+    SubpythonStatus status = check_type(session, dict, VAL_DICT);
+
+    if (status == SUBPYTHON_OK) {
+        *length = deref(session, dict)->dict->count;
+    }
+
+    return status;
+}
+
+SubpythonStatus subpython_dict_entry(Subpython *session, SubpythonValue dict,
+                                     size_t index, SubpythonValue *key,
+                                     SubpythonValue *value) {
+    SubpythonStatus status = check_type(session, dict, VAL_DICT);
+
+    if (status != SUBPYTHON_OK) {
+        return status;
+    }
+
+    DictTable *table = deref(session, dict)->dict;
+
+    if (index >= (size_t) table->count) {
+        return SUBPYTHON_INDEX_ERROR;
+    }
+
+    *key = dict_entries(table)[index].key;
+    *value = dict_entries(table)[index].value;
+    return SUBPYTHON_OK;
+}
+
+/*! Looks up a key, which has to be a float or a rooted string. */
+static SubpythonStatus lookup(Interp *interp, RefId dict, RefId key,
+                              SubpythonValue *value) {
+    RefId found = dict_get(interp, dict, key);
+
+    if (found == -1) {
+        return SUBPYTHON_NOT_FOUND;
+    }
+
+    *value = found;
+    return SUBPYTHON_OK;
+}
+
+SubpythonStatus subpython_dict_get(Subpython *session, SubpythonValue dict,
+                                   const char *key, SubpythonValue *value) {
+    SubpythonStatus status = check_type(session, dict, VAL_DICT);
+
+    if (status != SUBPYTHON_OK) {
+        return status;
+    }
+
+    /* The key needs a string of its own for the table to compare against.
+     * Allocating it may collect, but everything the host holds a handle to
+     * is reachable from the globals, and so survives. */
+    if (setjmp(session->error_jmp)) {
+        gc_clear_temporaries(session);
+        return SUBPYTHON_ERROR;
+    }
+
+    status = lookup(session, dict,
+                    make_reference_string(session, (char *) key), value);
+    gc_clear_temporaries(session);
+    return status;
+}
+
+SubpythonStatus subpython_dict_get_float(Subpython *session,
+                                         SubpythonValue dict, float key,
+                                         SubpythonValue *value) {
+    SubpythonStatus status = check_type(session, dict, VAL_DICT);
+
+    if (status != SUBPYTHON_OK) {
+        return status;
+    }
+
+    return lookup(session, dict, make_reference_float(key), value);
+}
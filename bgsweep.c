@@ -0,0 +1,351 @@
+/*! \file
+ * Background sweeping.  With BACKGROUND_SWEEP, a full collection's pause ends
+ * with its mark: rather than compacting, it hands the regions and the
+ * reference table over to a sweeper thread, started by the session's first
+ * full collection and kept until it ends, and the mutator carries on.
+ *
+ * The sweeper frees the dead blocks of each region in place, telling them by
+ * their color alone (see myalloc_sweep_region()), and then releases the dead
+ * reference slots and clears the survivors' marks, a chunk at a time.  It
+ * publishes each region and each chunk of free slots as it finishes them,
+ * and the mutator takes them on whenever it next looks, in bgsweep_poll().
+ *
+ * Until then the unswept regions and slots are the sweeper's alone.  The
+ * mutator allocates blocks only in swept regions, or ones added since, and
+ * refs only from swept slots or past the end of the table as it was when the
+ * sweep began.  It only waits when none of those will do, or when the table
+ * needs to grow, which would move it.  Marks are left alone meanwhile: a
+ * minor collection only looks at young refs' marks, which the sweeper never
+ * reaches, and the next full collection waits for the sweep to finish.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "global.h"
+#include "eval.h"
+#include "interp.h"
+#include "myalloc.h"
+#include "bgsweep.h"
+
+/*! How many table slots the sweeper releases between publishing them. */
+#define REF_CHUNK 4096
+
+typedef struct Sweeper {
+    pthread_t thread;
+
+    /*! `wake` tells the sweeper a sweep has begun, or that it should exit;
+        `progress` tells the mutator something more is swept.  The fields
+        from here on are under `lock`. */
+    pthread_mutex_t lock;
+    pthread_cond_t wake, progress;
+    bool shutdown;
+    /*! Set by the mutator to start a sweep, cleared by the sweeper when it
+        is done. */
+    bool busy;
+    /*! Bumped whenever the sweeper publishes something, and read without
+        the lock by the mutator, to see if there is anything new. */
+    atomic_uint published;
+
+    /*! The sweep's work, fixed when it starts: a copy of each region, the
+        table slots below num_refs, and the color of live blocks. */
+    struct Region *regions;
+    int num_regions, max_regions;
+    size_t *free_bytes;
+    Reference *table;
+    int num_refs;
+    bool color;
+
+    /*! Progress: regions below regions_done are swept, and the slots
+        released but not yet taken are linked from free_head to free_tail. */
+    int regions_done;
+    RefId free_head, free_tail;
+    size_t bytes_freed;
+    int refs_freed;
+
+    /*! The value of `published` the mutator last took things on at; only
+        the mutator touches it. */
+    unsigned int seen;
+} Sweeper;
+
+/*! Marks the end of a piece of work and wakes the mutator, if it waits. */
+static void publish(Sweeper *sweeper) {
+    atomic_fetch_add(&sweeper->published, 1);
+    pthread_cond_broadcast(&sweeper->progress);
+}
+
+/*! Releases the unmarked slots in [begin, end), and clears the marks of the
+    rest, then hands the free ones, lowest first, to the mutator. */
+static void release_refs(Sweeper *sweeper, int begin, int end) {
+    Reference *table = sweeper->table;
+    RefId head = -1, tail = -1;
+    int refs_freed = 0;
+
+    for (int i = begin; i < end; i++) {
+        if (table[i].occupied && table[i].marked) {
+            table[i].marked = false;
+            continue;
+        }
+
+        if (table[i].occupied) {
+            table[i].occupied = false;
+            table[i].type = VAL_EMPTY;
+            refs_freed++;
+        }
+
+        table[i].next_free = -1;
+        if (tail == -1) {
+            head = i;
+        } else {
+            table[tail].next_free = i;
+        }
+        tail = i;
+    }
+
+    pthread_mutex_lock(&sweeper->lock);
+    if (head != -1) {
+        if (sweeper->free_tail == -1) {
+            sweeper->free_head = head;
+        } else {
+            table[sweeper->free_tail].next_free = head;
+        }
+        sweeper->free_tail = tail;
+    }
+    sweeper->refs_freed += refs_freed;
+    publish(sweeper);
+    pthread_mutex_unlock(&sweeper->lock);
+}
+
+/*! Does one sweep: the regions in order, then the table. */
+static void sweep(Sweeper *sweeper) {
+    for (int i = 0; i < sweeper->num_regions; i++) {
+        size_t freed = myalloc_sweep_region(&sweeper->regions[i],
+                                            sweeper->color,
+                                            &sweeper->free_bytes[i]);
+
+        pthread_mutex_lock(&sweeper->lock);
+        sweeper->regions_done = i + 1;
+        sweeper->bytes_freed += freed;
+        publish(sweeper);
+        pthread_mutex_unlock(&sweeper->lock);
+    }
+
+    for (int i = 0; i < sweeper->num_refs; i += REF_CHUNK) {
+        release_refs(sweeper, i, i + REF_CHUNK < sweeper->num_refs ?
+                                 i + REF_CHUNK : sweeper->num_refs);
+    }
+
+    pthread_mutex_lock(&sweeper->lock);
+    sweeper->busy = false;
+    publish(sweeper);
+    pthread_mutex_unlock(&sweeper->lock);
+}
+
+/*! The sweeper thread: sweeps whenever asked to, until shut down. */
+static void *sweeper_main(void *arg) {
+    Sweeper *sweeper = arg;
+
+    pthread_mutex_lock(&sweeper->lock);
+    for (;;) {
+        while (!sweeper->busy && !sweeper->shutdown) {
+            pthread_cond_wait(&sweeper->wake, &sweeper->lock);
+        }
+
+        if (sweeper->shutdown) {
+            break;
+        }
+
+        pthread_mutex_unlock(&sweeper->lock);
+        sweep(sweeper);
+        pthread_mutex_lock(&sweeper->lock);
+    }
+    pthread_mutex_unlock(&sweeper->lock);
+
+    return NULL;
+}
+
+/*! Returns the session's sweeper, starting its thread if need be, or NULL
+    if it can't be had. */
+static Sweeper *get_sweeper(Interp *interp) {
+    Sweeper *sweeper = interp->sweeper;
+
+    if (sweeper != NULL) {
+        return sweeper;
+    }
+
+    sweeper = calloc(1, sizeof(Sweeper));
+    if (sweeper == NULL) {
+        return NULL;
+    }
+
+    atomic_init(&sweeper->published, 0);
+    pthread_mutex_init(&sweeper->lock, NULL);
+    pthread_cond_init(&sweeper->wake, NULL);
+    pthread_cond_init(&sweeper->progress, NULL);
+
+    if (pthread_create(&sweeper->thread, NULL, sweeper_main, sweeper) != 0) {
+        pthread_mutex_destroy(&sweeper->lock);
+        pthread_cond_destroy(&sweeper->wake);
+        pthread_cond_destroy(&sweeper->progress);
+        free(sweeper);
+        return NULL;
+    }
+
+    interp->sweeper = sweeper;
+    return sweeper;
+}
+
+/*!
+ * Hands every region and the reference table to the sweeper, once a full
+ * collection has marked and promoted.  Blocks of interp->block_color are
+ * live, and so are the marked refs.  The free list starts over, empty, as
+ * the sweeper rebuilds it.  Returns false, having done nothing, if there's
+ * no sweeper to be had, in which case the caller should sweep itself.
+ */
+bool bgsweep_start(Interp *interp) {
+    Sweeper *sweeper = get_sweeper(interp);
+
+    if (sweeper == NULL) {
+        return false;
+    }
+
+    if (interp->num_regions > sweeper->max_regions) {
+        int max_regions = interp->max_regions;
+        struct Region *regions = realloc(sweeper->regions,
+                                         sizeof(struct Region) * max_regions);
+
+        if (regions == NULL) {
+            return false;
+        }
+        sweeper->regions = regions;
+
+        size_t *free_bytes = realloc(sweeper->free_bytes,
+                                     sizeof(size_t) * max_regions);
+
+        if (free_bytes == NULL) {
+            return false;
+        }
+        sweeper->free_bytes = free_bytes;
+        sweeper->max_regions = max_regions;
+    }
+
+    for (int i = 0; i < interp->num_regions; i++) {
+        sweeper->regions[i] = interp->regions[i];
+    }
+    sweeper->num_regions = interp->num_regions;
+    sweeper->table = interp->ref_table;
+    sweeper->num_refs = interp->num_refs;
+    sweeper->color = interp->block_color;
+    sweeper->regions_done = 0;
+    sweeper->free_head = sweeper->free_tail = -1;
+    sweeper->bytes_freed = 0;
+    sweeper->refs_freed = 0;
+
+    interp->free_refs = -1;
+    interp->hole_bytes = 0;
+    interp->alloc_region = 0;
+    interp->unswept_begin = 0;
+    interp->unswept_end = interp->num_regions;
+    interp->sweeping = true;
+
+    pthread_mutex_lock(&sweeper->lock);
+    sweeper->busy = true;
+    pthread_cond_signal(&sweeper->wake);
+    pthread_mutex_unlock(&sweeper->lock);
+
+    return true;
+}
+
+/*!
+ * Takes on whatever the sweep under way has finished since last time: swept
+ * regions can be allocated in again, and released slots join the free list.
+ * With `wait`, first waits for the sweeper to finish something more.  Once
+ * the sweep is done, resets the early-collection budget.  Returns false if
+ * there was no sweep under way.
+ */
+bool bgsweep_poll(Interp *interp, bool wait) {
+    Sweeper *sweeper = interp->sweeper;
+
+    if (!interp->sweeping) {
+        return false;
+    }
+
+    if (!wait && atomic_load_explicit(&sweeper->published,
+                                      memory_order_relaxed) == sweeper->seen) {
+        return true;
+    }
+
+    pthread_mutex_lock(&sweeper->lock);
+    while (wait && sweeper->busy &&
+           atomic_load(&sweeper->published) == sweeper->seen) {
+        pthread_cond_wait(&sweeper->progress, &sweeper->lock);
+    }
+    sweeper->seen = atomic_load(&sweeper->published);
+
+    myalloc_note_peak(interp);
+    for (int i = interp->unswept_begin; i < sweeper->regions_done; i++) {
+        interp->regions[i].freeptr = sweeper->regions[i].freeptr;
+        interp->regions[i].holes = sweeper->regions[i].holes;
+        interp->hole_bytes += sweeper->free_bytes[i];
+    }
+    interp->unswept_begin = sweeper->regions_done;
+
+    if (sweeper->free_head != -1) {
+        interp->ref_table[sweeper->free_tail].next_free = interp->free_refs;
+        interp->free_refs = sweeper->free_head;
+        sweeper->free_head = sweeper->free_tail = -1;
+    }
+
+    bool done = !sweeper->busy;
+    pthread_mutex_unlock(&sweeper->lock);
+
+    if (done) {
+        interp->sweeping = false;
+        interp->unswept_begin = interp->unswept_end = 0;
+        myalloc_rebudget(interp);
+    }
+
+    return true;
+}
+
+/*! Waits for the sweep under way, if any, to finish, and adds what it freed
+    to `stats`, if given. */
+void bgsweep_finish(Interp *interp, GCStats *stats) {
+    if (!interp->sweeping) {
+        return;
+    }
+
+    while (bgsweep_poll(interp, true)) {
+    }
+
+    if (stats != NULL) {
+        stats->bytes_freed += interp->sweeper->bytes_freed;
+        stats->refs_freed += interp->sweeper->refs_freed;
+    }
+}
+
+/*! Stops and frees the session's sweeper, if it has one, once it is done
+    with any sweep under way. */
+void bgsweep_destroy(Interp *interp) {
+    Sweeper *sweeper = interp->sweeper;
+
+    if (sweeper == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&sweeper->lock);
+    sweeper->shutdown = true;
+    pthread_cond_signal(&sweeper->wake);
+    pthread_mutex_unlock(&sweeper->lock);
+    pthread_join(sweeper->thread, NULL);
+
+    pthread_mutex_destroy(&sweeper->lock);
+    pthread_cond_destroy(&sweeper->wake);
+    pthread_cond_destroy(&sweeper->progress);
+    free(sweeper->regions);
+    free(sweeper->free_bytes);
+    free(sweeper);
+    interp->sweeper = NULL;
+    interp->sweeping = false;
+}
@@ -0,0 +1,24 @@
+/*! \file
+ * Declarations for the sweeper thread that full collections hand the heap
+ * and the reference table to when BACKGROUND_SWEEP is set.
+ */
+
+#ifndef BGSWEEP_H
+#define BGSWEEP_H
+
+#include "eval.h"
+#include "gc.h"
+
+/* Start sweeping after a full collection's mark, in the background. */
+bool bgsweep_start(Interp *interp);
+
+/* Take on what the sweep under way has finished; false if there is none. */
+bool bgsweep_poll(Interp *interp, bool wait);
+
+/* Wait for the sweep under way, if any, to finish. */
+void bgsweep_finish(Interp *interp, GCStats *stats);
+
+/* Stop the session's sweeper thread, if it has one. */
+void bgsweep_destroy(Interp *interp);
+
+#endif /* BGSWEEP_H */
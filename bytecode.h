@@ -0,0 +1,75 @@
+/*! \file
+ * Declarations for the bytecode that parsed statements are compiled into, and
+ * for the compiler itself.
+ */
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+
+#include "global.h"
+#include "symtab.h"
+
+/*!
+ * The VM's instruction set.  Each opcode is one 32-bit word, followed by the
+ * operand words noted below; "top" is the top of the value stack.
+ */
+typedef enum Opcode {
+    OP_PUSH_FLOAT,      /*!< [float bits] Push a float. */
+    OP_PUSH_STRING,     /*!< [start, length] Push a new copy of a string
+                             constant, a slice of the code's text. */
+    OP_LOAD_GLOBAL,     /*!< [name] Push a global's value. */
+    OP_STORE_GLOBAL,    /*!< [name] Bind a global to top, leaving it. */
+    OP_SUBSCRIPT,       /*!< Pop key and container, push container[key]. */
+    OP_STORE_SUBSCRIPT, /*!< Pop key and container, container[key] = top. */
+    OP_NEGATE,          /*!< Replace top with -top. */
+    OP_ADD,             /*!< Pop rhs and lhs, push lhs + rhs. */
+    OP_SUB,             /*!< Pop rhs and lhs, push lhs - rhs. */
+    OP_MULT,            /*!< Pop rhs and lhs, push lhs * rhs. */
+    OP_DIV,             /*!< Pop rhs and lhs, push lhs / rhs. */
+    OP_BUILD_LIST,      /*!< [n] Pop n items, push a list of them. */
+    OP_BUILD_DICT,      /*!< [n] Pop n key/value pairs, push a dict. */
+    OP_PRINT,           /*!< Pop and print top. */
+    OP_POP,             /*!< Pop and discard top. */
+    OP_DELETE_GLOBAL,   /*!< [name] Delete a global. */
+    OP_GC,              /*!< Run the collector and report on it. */
+    OP_RETURN,          /*!< Stop executing. */
+    NUM_OPCODES
+} Opcode;
+
+/*!
+ * A compiled statement.  Its string constants are slices of the statement's
+ * line, which it borrows until it is cached and then keeps a copy of; it
+ * owns copies of its names.  Each session caches the code of the lines it
+ * runs more than once by their text, so a line run again skips lexing,
+ * parsing and compiling, and its global names keep the slots they last
+ * resolved to.
+ */
+typedef struct Code {
+    const char *text;
+    size_t length;
+    unsigned int hash;
+    bool owns_text;
+
+    uint32_t *ops;
+    int num_ops, max_ops;
+
+    GlobalRef *names;
+    int num_names, max_names;
+
+    /*! Deepest the value stack gets while running this code. */
+    int max_stack;
+} Code;
+
+Code *new_code(Interp *interp, const char *text, size_t length,
+               unsigned int hash);
+void compile_statement(Interp *interp, ParseStatement *stmt, Code *code);
+void free_code(Code *code);
+
+Code *code_cache_find(Interp *interp, const char *text, size_t length,
+                      unsigned int hash);
+bool code_cache_offer(Interp *interp, Code *code);
+void code_cache_clear(Interp *interp);
+
+#endif /* BYTECODE_H */
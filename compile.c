@@ -0,0 +1,328 @@
+/*! \file
+ * Compiles parsed statements into bytecode for the stack VM.  Expressions are
+ * emitted in evaluation order: operands before their operator and, for
+ * assignments, the value before the target it is stored into.
+ *
+ * Compiled statements are cached per session by the text of their line, in
+ * an open-addressing table of CODE_CACHE_SLOTS entries.  It holds at most
+ * CODE_CACHE_MAX of them, and starts over empty once it is full, rather than
+ * keeping track of which are still in use.  A line only gets in the second
+ * time it is compiled, so lines that are only ever run once cost no more
+ * than a hash: the first time, its hash is just noted in a direct-mapped
+ * table of CODE_SEEN_SLOTS entries.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "bytecode.h"
+#include "interp.h"
+
+#define CODE_CACHE_MAX 1024
+#define CODE_CACHE_SLOTS (2 * CODE_CACHE_MAX)
+#define CODE_SEEN_SLOTS 4096
+
+static void *grow(Interp *interp, void *array, int *max, size_t elem_size) {
+    *max = *max == 0 ? INITIAL_SIZE : *max * 2;
+    array = realloc(array, elem_size * *max);
+
+    if (array == NULL) {
+        error(interp, -1, "%s", "Allocation failed!");
+    }
+
+    return array;
+}
+
+/*! Appends one word, adjusting the tracked stack depth by `effect`. */
+static void emit(Interp *interp, Code *code, uint32_t word, int effect) {
+    if (code->num_ops == code->max_ops) {
+        code->ops = grow(interp, code->ops, &code->max_ops, sizeof(uint32_t));
+    }
+
+    code->ops[code->num_ops++] = word;
+    interp->stack_depth += effect;
+
+    if (interp->stack_depth > code->max_stack) {
+        code->max_stack = interp->stack_depth;
+    }
+}
+
+/*! Returns the name table index of `name`, adding it if it isn't there. */
+static uint32_t add_name(Interp *interp, Code *code, const char *name) {
+    for (int i = 0; i < code->num_names; i++) {
+        if (strcmp(code->names[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    if (code->num_names == code->max_names) {
+        code->names = grow(interp, code->names, &code->max_names,
+                           sizeof(GlobalRef));
+    }
+
+    char *copy = strdup(name);
+
+    if (copy == NULL) {
+        error(interp, -1, "%s", "Allocation failed!");
+    }
+
+    code->names[code->num_names].name = copy;
+    code->names[code->num_names].slot = -1;
+    return code->num_names++;
+}
+
+static void compile_expr(Interp *interp, Code *code, ExprId id);
+
+/*! Compiles a store of the value on top of the stack into `target`, leaving
+    the value there. */
+static void compile_store(Interp *interp, Code *code, ExprId id) {
+    ParseExpression *target = parse_expr(interp, id);
+
+    switch (target->type) {
+        case EXPR_IDENT:
+            emit(interp, code, OP_STORE_GLOBAL, 0);
+            emit(interp, code,
+                 add_name(interp, code, parse_string(interp, target->string)),
+                 0);
+            break;
+        case EXPR_SUBSCRIPT:
+            compile_expr(interp, code, target->lhs);
+            compile_expr(interp, code, target->rhs);
+            emit(interp, code, OP_STORE_SUBSCRIPT, -2);
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+static void compile_binary(Interp *interp, Code *code, ParseExpression *expr,
+                           Opcode op) {
+    compile_expr(interp, code, expr->lhs);
+    compile_expr(interp, code, expr->rhs);
+    emit(interp, code, op, -1);
+}
+
+static void compile_expr(Interp *interp, Code *code, ExprId id) {
+    ParseExpression *expr = parse_expr(interp, id);
+
+    switch (expr->type) {
+        case EXPR_SUBSCRIPT:
+            compile_binary(interp, code, expr, OP_SUBSCRIPT);
+            break;
+        case EXPR_NEGATE:
+            compile_expr(interp, code, expr->lhs);
+            emit(interp, code, OP_NEGATE, 0);
+            break;
+        case EXPR_IDENT:
+            emit(interp, code, OP_LOAD_GLOBAL, 1);
+            emit(interp, code,
+                 add_name(interp, code, parse_string(interp, expr->string)),
+                 0);
+            break;
+        case EXPR_STRING:
+            emit(interp, code, OP_PUSH_STRING, 1);
+            emit(interp, code, expr->slice.start, 0);
+            emit(interp, code, expr->slice.length, 0);
+            break;
+        case EXPR_FLOAT: {
+            union { float f; uint32_t bits; } u = { .f = expr->float_value };
+            emit(interp, code, OP_PUSH_FLOAT, 1);
+            emit(interp, code, u.bits, 0);
+            break;
+        }
+        case EXPR_LIST: {
+            int length = expr->items.length;
+            ExprId item = expr->items.first;
+
+            for (int i = 0; i < length; i++) {
+                compile_expr(interp, code, item);
+                item = parse_expr(interp, item)->next;
+            }
+
+            emit(interp, code, OP_BUILD_LIST, 1 - length);
+            emit(interp, code, length, 0);
+            break;
+        }
+        case EXPR_DICT: {
+            /* Keys and values alternate along the item chain. */
+            int num_entries = expr->items.length;
+            ExprId item = expr->items.first;
+
+            for (int i = 0; i < 2 * num_entries; i++) {
+                compile_expr(interp, code, item);
+                item = parse_expr(interp, item)->next;
+            }
+
+            emit(interp, code, OP_BUILD_DICT, 1 - 2 * num_entries);
+            emit(interp, code, num_entries, 0);
+            break;
+        }
+        case EXPR_ASSIGN:
+            /* The value first: evaluating the target may allocate, and the
+             * store must see the target's final location. */
+            compile_expr(interp, code, expr->rhs);
+            compile_store(interp, code, expr->lhs);
+            break;
+        case EXPR_ADD:
+            compile_binary(interp, code, expr, OP_ADD);
+            break;
+        case EXPR_SUB:
+            compile_binary(interp, code, expr, OP_SUB);
+            break;
+        case EXPR_MULT:
+            compile_binary(interp, code, expr, OP_MULT);
+            break;
+        case EXPR_DIV:
+            compile_binary(interp, code, expr, OP_DIV);
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+/*! Creates an empty Code object for the line `text`, of `length` chars,
+    whose text hashes to `hash` (see hash_bytes()).  The text is only
+    borrowed, until the code is cached. */
+Code *new_code(Interp *interp, const char *text, size_t length,
+               unsigned int hash) {
+    Code *code = calloc(1, sizeof(Code));
+
+    if (code == NULL) {
+        error(interp, -1, "%s", "Allocation failed!");
+    }
+
+    code->text = text;
+    code->length = length;
+    code->hash = hash;
+    return code;
+}
+
+/*! Compiles a statement, read from the line `code` was created for, into
+    `code`.  The caller still owns the code if this raises an error. */
+void compile_statement(Interp *interp, ParseStatement *stmt, Code *code) {
+    interp->stack_depth = 0;
+
+    switch (stmt->type) {
+        case STMT_DEL:
+            emit(interp, code, OP_DELETE_GLOBAL, 0);
+            emit(interp, code,
+                 add_name(interp, code,
+                          parse_string(interp, stmt->identifier)),
+                 0);
+            break;
+        case STMT_EXPR:
+            compile_expr(interp, code, stmt->expr);
+            /* Bare expressions are echoed, assignments aren't. */
+            emit(interp, code,
+                 parse_expr(interp, stmt->expr)->type == EXPR_ASSIGN ?
+                 OP_POP : OP_PRINT, -1);
+            break;
+        case STMT_GC:
+            emit(interp, code, OP_GC, 0);
+            break;
+    }
+
+    emit(interp, code, OP_RETURN, 0);
+}
+
+void free_code(Code *code) {
+    for (int i = 0; i < code->num_names; i++) {
+        free(code->names[i].name);
+    }
+
+    if (code->owns_text) {
+        free((char *) code->text);
+    }
+
+    free(code->names);
+    free(code->ops);
+    free(code);
+}
+
+/*! Returns the cached code for the line `text`, of `length` chars, whose text
+    hashes to `hash`, or NULL if it hasn't been cached. */
+Code *code_cache_find(Interp *interp, const char *text, size_t length,
+                      unsigned int hash) {
+    if (interp->code_cache == NULL) {
+        return NULL;
+    }
+
+    unsigned int slot = hash & (CODE_CACHE_SLOTS - 1);
+    Code *code;
+
+    while ((code = interp->code_cache[slot]) != NULL) {
+        if (code->hash == hash && code->length == length &&
+            memcmp(code->text, text, length) == 0) {
+            return code;
+        }
+
+        slot = (slot + 1) & (CODE_CACHE_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+/*!
+ * Offers freshly compiled `code`, whose line isn't cached, to the cache.  If
+ * the line has been seen before, the cache takes the code, along with a copy
+ * of its text, and returns true; otherwise the caller keeps it.
+ */
+bool code_cache_offer(Interp *interp, Code *code) {
+    if (interp->code_cache == NULL) {
+        interp->code_cache = calloc(CODE_CACHE_SLOTS, sizeof(Code *));
+        interp->code_seen = calloc(CODE_SEEN_SLOTS, sizeof(unsigned int));
+
+        if (interp->code_cache == NULL || interp->code_seen == NULL) {
+            error(interp, -1, "%s", "Allocation failed!");
+        }
+    }
+
+    unsigned int *seen = &interp->code_seen[code->hash &
+                                            (CODE_SEEN_SLOTS - 1)];
+
+    if (*seen != code->hash) {
+        *seen = code->hash;
+        return false;
+    }
+
+    char *text = malloc(code->length);
+
+    if (text == NULL && code->length != 0) {
+        error(interp, -1, "%s", "Allocation failed!");
+    }
+
+    memcpy(text, code->text, code->length);
+    code->text = text;
+    code->owns_text = true;
+
+    if (interp->code_cache_used == CODE_CACHE_MAX) {
+        code_cache_clear(interp);
+    }
+
+    unsigned int slot = code->hash & (CODE_CACHE_SLOTS - 1);
+
+    while (interp->code_cache[slot] != NULL) {
+        slot = (slot + 1) & (CODE_CACHE_SLOTS - 1);
+    }
+
+    interp->code_cache[slot] = code;
+    interp->code_cache_used++;
+    return true;
+}
+
+/*! Frees every cached Code, leaving the cache empty. */
+void code_cache_clear(Interp *interp) {
+    if (interp->code_cache == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < CODE_CACHE_SLOTS; i++) {
+        if (interp->code_cache[i] != NULL) {
+            free_code(interp->code_cache[i]);
+            interp->code_cache[i] = NULL;
+        }
+    }
+
+    interp->code_cache_used = 0;
+}
@@ -0,0 +1,160 @@
+/*! \file
+ * The dict value type: an insertion-ordered hash table with open addressing
+ * and linear probing, kept in the managed pool.  Key hashes are cached in the
+ * entries, so neither probing nor growing rehashes a key.
+ */
+
+#include <string.h>
+
+#include "global.h"
+#include "eval.h"
+#include "interp.h"
+#include "dict.h"
+#include "myalloc.h"
+#include "gc.h"
+
+/*! Bytes needed for a table with `capacity` slots, entries included. */
+static int dict_table_size(int capacity) {
+    return sizeof(DictTable) + sizeof(int) * capacity +
+           sizeof(DictEntry) * DICT_MAX_ENTRIES(capacity);
+}
+
+/*!
+ * Allocates a table with `capacity` slots for `dict`, re-inserting the
+ * entries of its current table (if any), and installs it.  The old block is
+ * left for the collector, which drops it since the ref no longer points at it.
+ */
+static void dict_resize(Interp *interp, RefId dict, int capacity) {
+    DictTable *table = myalloc(interp, dict_table_size(capacity), dict);
+
+    /* myalloc may have compacted the pool, so fetch the old table only now. */
+    DictTable *old = deref(interp, dict)->type == VAL_DICT ?
+                     deref(interp, dict)->dict : NULL;
+
+    table->count = 0;
+    table->capacity = capacity;
+    memset(table->slots, -1, sizeof(int) * capacity);
+
+    if (old != NULL) {
+        DictEntry *old_entries = dict_entries(old);
+        DictEntry *entries = dict_entries(table);
+
+        memcpy(entries, old_entries, sizeof(DictEntry) * old->count);
+        table->count = old->count;
+
+        for (int i = 0; i < table->count; i++) {
+            unsigned int slot = entries[i].hash & (capacity - 1);
+
+            while (table->slots[slot] != -1) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+
+            table->slots[slot] = i;
+        }
+    }
+
+    deref(interp, dict)->type = VAL_DICT;
+    deref(interp, dict)->dict = table;
+}
+
+/*! Allocates an empty dict with room for at least `min_entries` pairs. */
+RefId make_reference_dict(Interp *interp, int min_entries) {
+    int capacity = INITIAL_SIZE;
+
+    while (DICT_MAX_ENTRIES(capacity) < min_entries) {
+        capacity *= 2;
+    }
+
+    RefId r = make_reference(interp);
+    dict_resize(interp, r, capacity);
+    return r;
+}
+
+/*! Hashes a dict key. Only works on strings and floats, like key_equals. */
+unsigned int key_hash(Interp *interp, RefId key) {
+    unsigned int hash;
+
+    switch (ref_type(interp, key)) {
+        case VAL_FLOAT:
+            /* 0.0 == -0.0, so they must hash alike. */
+            hash = ref_float(key) == 0 ? 0 : (unsigned int) key;
+            break;
+        case VAL_STRING:
+            hash = hash_string(deref(interp, key)->string_value);
+            break;
+        case VAL_LIST:
+        case VAL_DICT:
+            error(interp, -1, "%s",
+                  "Dict and List types are not valid key types.");
+        case VAL_EMPTY:
+        default:
+            UNREACHABLE();
+    }
+
+    /* Spread the bits, since the slot index only uses the low ones. */
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3bu;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/*! Returns the entry index holding `key`, or -1; `*slot_out` receives the
+    slot where it is (or would be) found. */
+static int dict_find(Interp *interp, DictTable *table, RefId key,
+                     unsigned int hash, unsigned int *slot_out) {
+    DictEntry *entries = dict_entries(table);
+    unsigned int slot = hash & (table->capacity - 1);
+
+    while (table->slots[slot] != -1) {
+        DictEntry *entry = &entries[table->slots[slot]];
+
+        if (entry->hash == hash && key_equals(interp, entry->key, key)) {
+            *slot_out = slot;
+            return table->slots[slot];
+        }
+
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    *slot_out = slot;
+    return -1;
+}
+
+/*! Looks `key` up in `dict`, returning its value, or -1 if it is missing. */
+RefId dict_get(Interp *interp, RefId dict, RefId key) {
+    DictTable *table = deref(interp, dict)->dict;
+    unsigned int slot;
+    int idx = dict_find(interp, table, key, key_hash(interp, key), &slot);
+
+    return idx == -1 ? -1 : dict_entries(table)[idx].value;
+}
+
+/*!
+ * Returns the value slot for `key` in `dict`, so it can be assigned, adding
+ * the key (with a value of -1) if it is missing.  The pointer is into the
+ * pool, so it must be written before anything else is allocated.
+ */
+RefId *dict_get_lval(Interp *interp, RefId dict, RefId key) {
+    unsigned int hash = key_hash(interp, key);
+    unsigned int slot;
+    DictTable *table = deref(interp, dict)->dict;
+    int idx = dict_find(interp, table, key, hash, &slot);
+
+    if (idx != -1) {
+        return &dict_entries(table)[idx].value;
+    }
+
+    if (table->count == DICT_MAX_ENTRIES(table->capacity)) {
+        dict_resize(interp, dict, table->capacity * 2);
+        table = deref(interp, dict)->dict;
+        dict_find(interp, table, key, hash, &slot);
+    }
+
+    idx = table->count++;
+    table->slots[slot] = idx;
+    dict_entries(table)[idx].hash = hash;
+    dict_entries(table)[idx].key = key;
+    dict_entries(table)[idx].value = -1;
+    gc_write_barrier(interp, dict, key);
+    return &dict_entries(table)[idx].value;
+}
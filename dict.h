@@ -0,0 +1,42 @@
+/*! \file
+ * Declarations for the hash-table dict value type.
+ */
+
+#ifndef DICT_H
+#define DICT_H
+
+#include "eval.h"
+
+/*! One key/value pair of a dict, along with the cached hash of its key. */
+typedef struct DictEntry {
+    unsigned int hash;
+    RefId key, value;
+} DictEntry;
+
+/*!
+ * An insertion-ordered, open-addressing hash table, stored as a single pool
+ * block owned by the dict's reference.  `slots` has `capacity` (a power of
+ * two) entries, each an index into the entry array or -1 if empty; the entry
+ * array follows the slots and has room for DICT_MAX_ENTRIES(capacity) pairs,
+ * of which the first `count` are in use, in insertion order.
+ */
+typedef struct DictTable {
+    int count;
+    int capacity;
+    int slots[];
+} DictTable;
+
+/*! Keep the probe sequences short by filling at most 2/3 of the slots. */
+#define DICT_MAX_ENTRIES(capacity) ((capacity) * 2 / 3)
+
+/*! The entry array that follows a table's slots. */
+static inline DictEntry *dict_entries(DictTable *table) {
+    return (DictEntry *) (table->slots + table->capacity);
+}
+
+RefId make_reference_dict(Interp *interp, int min_entries);
+RefId dict_get(Interp *interp, RefId dict, RefId key);
+RefId *dict_get_lval(Interp *interp, RefId dict, RefId key);
+unsigned int key_hash(Interp *interp, RefId key);
+
+#endif /* DICT_H */
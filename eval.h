@@ -1,67 +1,89 @@
 #ifndef EVAL_H
 #define EVAL_H
 
+#include <stdint.h>
+
 #include "global.h"
 
-typedef int RefId;
+/*!
+ * A handle to a value.  Non-negative values below 2^32 index the reference
+ * table.  Floats are immediates: their bits sit in the low half, tagged by
+ * FLOAT_TAG in the high half, so numbers never take a ref slot or pool block.
+ * -1 means "no value".
+ */
+typedef int64_t RefId;
+
+#define FLOAT_TAG ((RefId) 1 << 32)
 
 //TODO: should these go in global?
 
 typedef struct Reference {
-    //IDEA: in the mark and sweep, they can just set occupied = false at
-    // the beginning for ALL refs, then marking is just setting occupied = true.
+    /*! True while this slot belongs to some value; cleared by the sweeper. */
     bool occupied;
 
+    /*! Set by the collector's mark phase when the value is reachable. */
+    bool marked;
+
+    /*! False while the value is young: created since the last collection,
+        with its block (if small enough) in the nursery. */
+    bool old;
+
+    /*! Set on an old list or dict while it is in the remembered set. */
+    bool remembered;
+
     enum Type {
         VAL_FLOAT,
         VAL_STRING,
-        VAL_LIST_NODE,
-        VAL_DICT_NODE,
+        VAL_LIST,
+        VAL_DICT,
         VAL_EMPTY
     } type;
 
+    /* Floats never live in the table; VAL_FLOAT is only ever reported by
+     * ref_type() for immediates. */
     union {
-        float *float_value;
         int *int_value;
         char *string_value;
-        struct ListNode *list_node;
-        struct DictNode *dict_node;
+        struct ListArray *list;
+        struct DictTable *dict;
+        /*! Next released slot, while this one sits on the free list. */
+        int next_free;
     };
 } Reference;
 
-typedef struct ListNode {
-    RefId next, value;
-} ListNode;
+/*! True if `ref` is an immediate float rather than a table index. */
+static inline bool is_float_ref(RefId ref) {
+    return (uint64_t) ref >> 32 == 1;
+}
+
+/*! Boxes a float as an immediate RefId. This never allocates. */
+static inline RefId make_reference_float(float f) {
+    union { float f; uint32_t bits; } u = { .f = f };
+    return FLOAT_TAG | u.bits;
+}
 
-typedef struct DictNode {
-    RefId next, key, value;
-} DictNode;
+/*! Unboxes an immediate float. */
+static inline float ref_float(RefId ref) {
+    union { float f; uint32_t bits; } u = { .bits = (uint32_t) ref };
+    return u.f;
+}
 
-void print_ref(RefId ref, bool newline, int depth);
+/*! How deeply nested values are printed before eliding with "...". */
+#define MAX_DEPTH 4
 
-void eval_stmt(struct ParseStatement *stmt);
-RefId eval_expr(struct ParseExpression *expr);
-RefId *eval_expr_lval(struct ParseExpression *expr);
+void print_ref(Interp *interp, RefId ref, bool newline, int depth);
 
 // Helpers
-float eval_expect_float(struct ParseExpression *expr);
-RefId *get_global_variable(char *name, bool create);
-void delete_global_variable(char *name);
-bool key_equals(RefId a, RefId b);
-struct Reference *deref(RefId id);
-struct ListNode *alloc_list_node(struct ListNode *next, RefId value);
-struct DictNode *alloc_dict_node(struct DictNode *next,
-                                 RefId key, RefId value);
-RefId make_reference();
-RefId make_reference_float(float f);
-RefId make_reference_string(char *c);
-RefId make_reference_list_node(RefId next, RefId value);
-RefId make_reference_dict_node(RefId next, RefId key, RefId value);
-void allocate_dict_node_into_ref(RefId current, RefId next, RefId key, RefId value);
-RefId make_list_terminator();
-RefId make_dict_terminator();
-void assign_ref(RefId a, RefId b);
-RefId key_clone(RefId ref);
-char *eval_string_dup(char *, RefId);
+bool key_equals(Interp *interp, RefId a, RefId b);
+struct Reference *deref(Interp *interp, RefId id);
+enum Type ref_type(Interp *interp, RefId id);
+void *deref_payload(Interp *interp, RefId id);
+void relocate_payload(Interp *interp, RefId id, void *payload);
+RefId make_reference(Interp *interp);
+RefId make_reference_string(Interp *interp, char *c);
+RefId make_reference_slice(Interp *interp, const char *c, size_t len);
+void assign_ref(Interp *interp, RefId a, RefId b);
+RefId key_clone(Interp *interp, RefId ref);
+char *eval_string_dup(Interp *interp, const char *, size_t, RefId);
 
 #endif /* EVAL_H */
@@ -0,0 +1,487 @@
+/*! \file
+ * A generational mark-compact garbage collector.  Marking starts at the global
+ * variables, the VM stack and the current statement's temporaries, and follows
+ * lists and dicts through the reference table; the allocator then slides the
+ * surviving pool blocks together, and the reference slots of everything left
+ * unmarked are released.
+ *
+ * Most values are temporaries that die with the statement that made them, so
+ * new refs start out young, with their blocks in the allocator's nursery.  A
+ * minor collection, run whenever the nursery fills, marks only the young refs,
+ * treating the old ones as live: it doesn't trace through them, except for
+ * those in the remembered set, the old lists and dicts the write barrier saw a
+ * young value stored into.  Every young ref that survives is promoted, its
+ * block copied out of the nursery into the main heap, and the nursery starts
+ * over empty.  A full collection marks everything, and promotes too.
+ *
+ * A full collection can also be incremental: gc_start_marking() begins it,
+ * and each gc_mark_step() shades the next globals grey, then traces grey refs,
+ * turning them black, until GC_PAUSE_BUDGET_US is spent.  Both work in chunks
+ * of MARK_CLOCK_INTERVAL values, a long list or dict being traced a chunk at
+ * a time, so no step overruns its budget by much.  Meanwhile the write
+ * barrier shades any old value stored into a list or dict, so that a black
+ * container never hides a white value (a Dijkstra barrier).  Stores into the
+ * roots aren't barriered, and young refs aren't marked by the steps, so the
+ * final pause, collect_garbage(), rescans the roots and the remembered set
+ * before compacting.  That pause is not bounded by the budget, since it
+ * compacts the whole heap, and is timed apart from the steps.
+ *
+ * With GC_MARK_THREADS above 1, that final pause traces on several threads
+ * at once; see parmark.c.  With BACKGROUND_SWEEP, it ends once marking does,
+ * leaving the sweep to another thread; see bgsweep.c.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include "global.h"
+#include "eval.h"
+#include "interp.h"
+#include "gc.h"
+#include "dict.h"
+#include "list.h"
+#include "symtab.h"
+#include "vm.h"
+#include "myalloc.h"
+#include "parmark.h"
+#include "bgsweep.h"
+
+/*! How many values an incremental step traces between reading the clock,
+    and so the most it takes of the globals or of one container at once. */
+#define MARK_CLOCK_INTERVAL 256
+
+/*! Appends `ref` to a growable array of RefIds. */
+static void push_ref(Interp *interp, RefId **array, int *count, int *max,
+                     RefId ref) {
+    if (*count == *max) {
+        *max = *max == 0 ? INITIAL_SIZE : *max * 2;
+        *array = realloc(*array, sizeof(RefId) * *max);
+
+        if (*array == NULL) {
+            error(interp, -1, "%s", "Allocation failed!");
+        }
+    }
+
+    (*array)[(*count)++] = ref;
+}
+
+/*! Which refs a mark pass marks and traces through. */
+typedef enum MarkScope {
+    MARK_ALL,
+    /*! A minor collection's: the young generation alone. */
+    MARK_YOUNG,
+    /*! An incremental step's: the old generation alone, since young refs
+        come and go with the minor collections until the final pause. */
+    MARK_OLD
+} MarkScope;
+
+/*! Seconds since `start`, recorded in `*longest` if longer. */
+static void record_pause(double start, double *longest) {
+    double pause = phase_clock() - start;
+
+    if (pause > *longest) {
+        *longest = pause;
+    }
+}
+
+/*! Marks a reference grey, queueing it to be traced, unless it has been
+    already or is out of scope. */
+static void mark_push(Interp *interp, RefId ref, MarkScope scope) {
+    if (ref < 0 || is_float_ref(ref)) {
+        return;
+    }
+
+    Reference *r = deref(interp, ref);
+
+    /* Age first: a background sweep may be clearing old refs' marks. */
+    if ((scope == MARK_YOUNG && r->old) || (scope == MARK_OLD && !r->old) ||
+        r->marked) {
+        return;
+    }
+
+    r->marked = true;
+    if (BACKGROUND_SWEEP) {
+        myalloc_mark_block(interp, ref);
+    }
+    push_ref(interp, &interp->mark_stack, &interp->mark_top,
+             &interp->mark_max, ref);
+}
+
+/*!
+ * Marks at most `max` of the items or entries a list or dict holds, starting
+ * from the `*next`th, and advances `*next` past them, or sets it to -1 once
+ * none are left.  Returns how many values were marked.  Items are only ever
+ * appended or overwritten, never moved, so a later call can carry on where
+ * this one stopped; the write barrier covers what is stored in between.
+ */
+static int mark_children_from(Interp *interp, RefId ref, int *next, int max,
+                              MarkScope scope) {
+    Reference *r = deref(interp, ref);
+    int from = *next, length, end;
+
+    if (r->type == VAL_LIST) {
+        length = r->list->length;
+        end = length - from > max ? from + max : length;
+
+        for (int i = from; i < end; i++) {
+            mark_push(interp, r->list->items[i], scope);
+        }
+    } else if (r->type == VAL_DICT) {
+        DictEntry *entries = dict_entries(r->dict);
+
+        length = r->dict->count;
+        end = length - from > max ? from + max : length;
+
+        for (int i = from; i < end; i++) {
+            mark_push(interp, entries[i].key, scope);
+            mark_push(interp, entries[i].value, scope);
+        }
+    } else {
+        *next = -1;
+        return 0;
+    }
+
+    *next = end < length ? end : -1;
+    return r->type == VAL_DICT ? 2 * (end - from) : end - from;
+}
+
+/*! Marks everything a list or dict holds. */
+static void mark_children(Interp *interp, RefId ref, MarkScope scope) {
+    int next = 0;
+
+    mark_children_from(interp, ref, &next, INT_MAX, scope);
+}
+
+/*!
+ * Shades the roots grey.  Old lists and dicts holding young values are roots
+ * of the young generation, and all the roots of the final pause, since an
+ * incremental step may have blackened them without seeing those values.  The
+ * steps of an incremental collection shade only the globals, and those a
+ * chunk at a time; see gc_mark_step().
+ */
+static void mark_roots(Interp *interp, MarkScope scope) {
+    for (int i = 0; i < interp->num_vars; i++) {
+        if (interp->global_vars[i].name != NULL) {
+            mark_push(interp, interp->global_vars[i].ref, scope);
+        }
+    }
+
+    for (int i = 0; i < interp->num_temp_roots; i++) {
+        mark_push(interp, interp->temp_roots[i], scope);
+    }
+
+    for (RefId *value = interp->vm_stack; value < interp->vm_sp; value++) {
+        mark_push(interp, *value, scope);
+    }
+
+    if (scope != MARK_OLD) {
+        for (int i = 0; i < interp->num_remembered; i++) {
+            mark_children(interp, interp->remembered[i], scope);
+        }
+    }
+}
+
+/*! Traces grey refs until only the `base` deepest are left on the stack. */
+static void mark_drain(Interp *interp, int base, MarkScope scope) {
+    while (interp->mark_top > base) {
+        mark_children(interp, interp->mark_stack[--interp->mark_top], scope);
+    }
+}
+
+/*! Empties the remembered set and the young generation, whose survivors
+    have all been promoted. */
+static void end_generation(Interp *interp) {
+    for (int i = 0; i < interp->num_remembered; i++) {
+        deref(interp, interp->remembered[i])->remembered = false;
+    }
+
+    interp->num_young = 0;
+    interp->num_remembered = 0;
+}
+
+/*!
+ * Releases every occupied reference slot the mark phase didn't reach, then
+ * keeps the table proportional to the live refs: free slots at the end are
+ * dropped, the allocation is halved while it is less than a quarter full, and
+ * the free list is rebuilt lowest id first, so new refs pack into the front of
+ * the table and leave the tail free for the next collection to trim.
+ *
+ * Live refs can't be renumbered here, since the evaluator may be holding
+ * RefIds in C locals when a collection is triggered from myalloc().
+ */
+static int sweep_refs(Interp *interp) {
+    Reference *table = interp->ref_table;
+    int num_refs = interp->num_refs, max_refs = interp->max_refs;
+    int refs_freed = 0;
+
+    for (int i = 0; i < num_refs; i++) {
+        if (table[i].occupied && !table[i].marked) {
+            table[i].occupied = false;
+            table[i].type = VAL_EMPTY;
+            table[i].string_value = NULL;
+            refs_freed++;
+        } else {
+            /* Leave every mark clear for the next collection. */
+            table[i].marked = false;
+        }
+    }
+
+    while (num_refs > 0 && !table[num_refs - 1].occupied) {
+        num_refs--;
+    }
+
+    if (max_refs > INITIAL_SIZE && num_refs < max_refs / 4) {
+        while (max_refs > INITIAL_SIZE && num_refs < max_refs / 4) {
+            max_refs /= 2;
+        }
+
+        /* Shrinking can't fail in practice, but keep the old table if so. */
+        Reference *shrunk = realloc(table, sizeof(struct Reference) * max_refs);
+        if (shrunk != NULL) {
+            table = shrunk;
+            interp->max_refs = max_refs;
+        }
+    }
+
+    interp->free_refs = -1;
+    for (int i = num_refs - 1; i >= 0; i--) {
+        if (!table[i].occupied) {
+            table[i].next_free = interp->free_refs;
+            interp->free_refs = i;
+        }
+    }
+
+    interp->ref_table = table;
+    interp->num_refs = num_refs;
+    return refs_freed;
+}
+
+void gc_root_temporary(Interp *interp, RefId ref) {
+    push_ref(interp, &interp->temp_roots, &interp->num_temp_roots,
+             &interp->max_temp_roots, ref);
+}
+
+void gc_clear_temporaries(Interp *interp) {
+    interp->num_temp_roots = 0;
+}
+
+/*! Adds a new ref to the young generation. */
+void gc_track_young(Interp *interp, RefId ref) {
+    push_ref(interp, &interp->young_refs, &interp->num_young,
+             &interp->max_young, ref);
+}
+
+/*!
+ * The write barrier, called after `value` is stored into the list or dict
+ * `container`.  While a full collection is marking, an old value is shaded,
+ * since the container may already be black.  And since a minor collection
+ * doesn't trace through old refs, an old container that now holds a young
+ * value joins the remembered set, to be traced as a root by the next one.
+ */
+void gc_write_barrier(Interp *interp, RefId container, RefId value) {
+    if (value < 0 || is_float_ref(value)) {
+        return;
+    }
+
+    Reference *v = deref(interp, value);
+
+    if (v->old) {
+        if (interp->marking && !v->marked) {
+            mark_push(interp, value, MARK_OLD);
+        }
+        return;
+    }
+
+    Reference *r = deref(interp, container);
+
+    if (r->old && !r->remembered) {
+        r->remembered = true;
+        push_ref(interp, &interp->remembered, &interp->num_remembered,
+                 &interp->max_remembered, container);
+    }
+}
+
+/*!
+ * Runs a minor collection: marks the young refs that are still reachable,
+ * moves their blocks out of the nursery and promotes them, and releases the
+ * slots of the rest.  Old refs are left alone, dead or not.  While a full
+ * collection is marking, the promoted refs join its grey set.
+ */
+GCStats collect_young(Interp *interp) {
+    GCStats stats = { 0, 0, 0 };
+    double start = phase_clock();
+    int grey = interp->mark_top;
+
+    /* A collection that ran out of memory part way may have left marks. */
+    for (int i = 0; i < interp->num_young; i++) {
+        deref(interp, interp->young_refs[i])->marked = false;
+    }
+
+    mark_roots(interp, MARK_YOUNG);
+    mark_drain(interp, grey, MARK_YOUNG);
+    stats.bytes_freed = myalloc_evacuate(interp);
+
+    /* Release the dead highest first, so the free list hands out low slots
+     * first. */
+    for (int i = interp->num_young - 1; i >= 0; i--) {
+        RefId ref = interp->young_refs[i];
+        Reference *r = deref(interp, ref);
+
+        if (!r->marked) {
+            r->occupied = false;
+            r->type = VAL_EMPTY;
+            r->next_free = interp->free_refs;
+            interp->free_refs = ref;
+            stats.refs_freed++;
+        } else if (interp->marking) {
+            r->old = true;
+            push_ref(interp, &interp->mark_stack, &interp->mark_top,
+                     &interp->mark_max, ref);
+        } else {
+            r->old = true;
+            r->marked = false;
+        }
+    }
+
+    end_generation(interp);
+    interp->minor_collections++;
+    record_pause(start, &interp->max_gc_pause);
+    return stats;
+}
+
+/*!
+ * Starts an incremental full collection.  Nothing is shaded yet: the steps
+ * shade the globals, and the final pause rescans every root anyway, which
+ * covers the temporaries and the VM stack.
+ */
+void gc_start_marking(Interp *interp) {
+    bgsweep_finish(interp, NULL);
+
+    double start = phase_clock();
+
+    if (BACKGROUND_SWEEP) {
+        interp->block_color = !interp->block_color;
+    }
+    interp->marking = true;
+    interp->globals_shaded = 0;
+    interp->mark_resume = -1;
+    record_pause(start, &interp->max_gc_pause);
+}
+
+/*!
+ * Shades the globals not yet shaded, then traces grey refs, until none are
+ * left or GC_PAUSE_BUDGET_US is spent, the clock being read every
+ * MARK_CLOCK_INTERVAL values.  A list or dict is traced that many values at
+ * a time too, and one cut short is left in mark_resume for the next step.
+ * Returns true once marking is done and collect_garbage() can finish the
+ * collection.
+ */
+bool gc_mark_step(Interp *interp) {
+    double start = phase_clock();
+    double deadline = start + GC_PAUSE_BUDGET_US / 1e6;
+    int work = 0;
+
+    while (true) {
+        if (interp->globals_shaded < interp->num_vars) {
+            int i = interp->globals_shaded;
+            int end = interp->num_vars - i > MARK_CLOCK_INTERVAL ?
+                      i + MARK_CLOCK_INTERVAL : interp->num_vars;
+
+            for (; i < end; i++) {
+                if (interp->global_vars[i].name != NULL) {
+                    mark_push(interp, interp->global_vars[i].ref, MARK_OLD);
+                }
+            }
+            work += end - interp->globals_shaded;
+            interp->globals_shaded = end;
+        } else if (interp->mark_resume != -1 || interp->mark_top > 0) {
+            if (interp->mark_resume == -1) {
+                interp->mark_resume = interp->mark_stack[--interp->mark_top];
+                interp->mark_resume_at = 0;
+                work++;
+            }
+
+            work += mark_children_from(interp, interp->mark_resume,
+                                       &interp->mark_resume_at,
+                                       MARK_CLOCK_INTERVAL, MARK_OLD);
+            if (interp->mark_resume_at == -1) {
+                interp->mark_resume = -1;
+            }
+        } else {
+            break;
+        }
+
+        if (work >= MARK_CLOCK_INTERVAL) {
+            work = 0;
+            if (phase_clock() >= deadline) {
+                break;
+            }
+        }
+    }
+
+    interp->mark_steps++;
+    record_pause(start, &interp->max_gc_pause);
+    return interp->globals_shaded >= interp->num_vars &&
+           interp->mark_resume == -1 && interp->mark_top == 0;
+}
+
+/*!
+ * Runs a full collection, or finishes the incremental one under way, and
+ * reports what it reclaimed.
+ */
+GCStats collect_garbage(Interp *interp) {
+    GCStats stats = { 0, 0, 0 };
+    double start = phase_clock();
+
+    /* The last collection's sweep must be done with the marks. */
+    bgsweep_finish(interp, NULL);
+
+    /* Set first, so a collection cut short by an error is resumed by the
+     * next, rather than mistaking its marks for a finished trace.  A
+     * container a step left part traced is grey again, to be traced whole. */
+    if (!interp->marking) {
+        if (BACKGROUND_SWEEP) {
+            interp->block_color = !interp->block_color;
+        }
+        interp->marking = true;
+    } else if (interp->mark_resume != -1) {
+        push_ref(interp, &interp->mark_stack, &interp->mark_top,
+                 &interp->mark_max, interp->mark_resume);
+        interp->mark_resume = -1;
+    }
+    mark_roots(interp, MARK_ALL);
+    if (GC_MARK_THREADS <= 1 || !parallel_mark(interp)) {
+        mark_drain(interp, 0, MARK_ALL);
+    }
+    stats.mark_seconds = phase_clock() - start;
+
+    /* Compaction and evacuation read the owners' marks and payloads, so they
+     * must run before the reference slots are cleared. */
+    if (BACKGROUND_SWEEP) {
+        stats.bytes_freed = myalloc_evacuate(interp);
+    } else {
+        stats.bytes_freed = myalloc_sweep(interp) + myalloc_evacuate(interp);
+    }
+
+    for (int i = 0; i < interp->num_young; i++) {
+        Reference *r = deref(interp, interp->young_refs[i]);
+
+        if (r->marked) {
+            r->old = true;
+        }
+    }
+
+    end_generation(interp);
+    if (!BACKGROUND_SWEEP) {
+        stats.refs_freed = sweep_refs(interp);
+    } else if (!bgsweep_start(interp)) {
+        /* There's no sweeper to be had, so sweep here after all. */
+        stats.bytes_freed += myalloc_sweep(interp);
+        stats.refs_freed = sweep_refs(interp);
+    }
+    interp->marking = false;
+    interp->full_collections++;
+    record_pause(start, &interp->max_final_pause);
+
+    return stats;
+}
@@ -0,0 +1,43 @@
+/*! \file
+ * Declarations for the generational mark-compact garbage collector that
+ * manages the reference table and the allocator's memory pool.
+ */
+
+#ifndef GC_H
+#define GC_H
+
+#include "eval.h"
+
+/*! What a single collection managed to reclaim. */
+typedef struct GCStats {
+    size_t bytes_freed;
+    int refs_freed;
+    /*! How long a full collection spent marking. */
+    double mark_seconds;
+} GCStats;
+
+/* Mark everything reachable from the globals, then compact the pool. */
+GCStats collect_garbage(Interp *interp);
+
+/* Collect the young generation alone, promoting its survivors. */
+GCStats collect_young(Interp *interp);
+
+/* Start an incremental full collection. */
+void gc_start_marking(Interp *interp);
+
+/* Mark for up to GC_PAUSE_BUDGET_US; true once marking is done. */
+bool gc_mark_step(Interp *interp);
+
+/* Treat a reference as a root until the current statement finishes. */
+void gc_root_temporary(Interp *interp, RefId ref);
+
+/* Drop the previous statement's temporaries from the root set. */
+void gc_clear_temporaries(Interp *interp);
+
+/* Add a new reference to the young generation. */
+void gc_track_young(Interp *interp, RefId ref);
+
+/* Note that `value` was stored into the list or dict `container`. */
+void gc_write_barrier(Interp *interp, RefId container, RefId value);
+
+#endif /* GC_H */
@@ -3,70 +3,120 @@
 #include <malloc.h>
 
 #include "global.h"
+#include "interp.h"
 #include "parse.h"
 
-void **ptr_array = NULL;
-int allocated_objs = 0, max_objs = 0;
-sigjmp_buf error_jmp;
-
 // Allocator used for the parse code, which is not managed by the student.
-void *parse_alloc(size_t sz) {
-    if (ptr_array == NULL) {
-        ptr_array = malloc(sizeof(void *) * INITIAL_SIZE);
-        max_objs = INITIAL_SIZE;
-    } else if (allocated_objs == max_objs) {
-        max_objs *= 2;
-        ptr_array = realloc(ptr_array, sizeof(void *) * max_objs);
+ExprId parse_new_expr(Interp *interp, ExpressionType type) {
+    if (interp->num_nodes == interp->max_nodes) {
+        interp->max_nodes = interp->max_nodes == 0 ?
+                            INITIAL_SIZE : interp->max_nodes * 2;
+        interp->parse_nodes = realloc(interp->parse_nodes,
+                                      sizeof(ParseExpression) *
+                                      interp->max_nodes);
+
+        if (interp->parse_nodes == NULL) {
+            error(interp, -1, "%s", "Allocation failed!");
+        }
     }
 
-    void *mem = malloc(sz);
-
-    if (mem == NULL || ptr_array == NULL) {
-        error(-1, "%s", "Allocation failed!");
-    }
+    ParseExpression *expr = &interp->parse_nodes[interp->num_nodes];
+    expr->type = type;
+    expr->next = NO_EXPR;
+    return interp->num_nodes++;
+}
 
-    ptr_array[allocated_objs++] = mem;
-    return mem;
+/*! Forgets every node and string, keeping the memory for the next
+    statement. */
+void parse_reset(Interp *interp) {
+    interp->num_nodes = 0;
+    interp->strings_used = 0;
 }
 
-void error(int pos, const char *fmt, ...)  {
-    printf("%s", curr_string());
+/*! Reports an error on the session's output and abandons the statement. */
+void error(Interp *interp, int pos, const char *fmt, ...)  {
+    FILE *out = interp->out;
+    const char *line = curr_string(interp);
+    va_list argptr;
+
+    va_start(argptr, fmt);
+    vsnprintf(interp->error_message, ERROR_MESSAGE_SIZE, fmt, argptr);
+    va_end(argptr);
+    interp->errors++;
+
+    if (out == NULL) {
+        longjmp(interp->error_jmp, 1);
+    }
+
+    // Only the statement's own line, in case more input follows it.
+    if (line != NULL) {
+        fprintf(out, "%.*s\n", (int) strcspn(line, "\n"), line);
+    }
 
     if (pos != -1) {
         for (int i = 0; i < pos; i++)
-            printf("-");
+            fprintf(out, "-");
 
-        printf("^\n");
+        fprintf(out, "^\n");
 
-        printf("Parse error: ");
+        fprintf(out, "Parse error: ");
     } else {
-        printf("Error: ");
+        fprintf(out, "Error: ");
     }
 
-    va_list argptr;
     va_start(argptr, fmt);
-    vfprintf(stdout, fmt, argptr);
+    vfprintf(out, fmt, argptr);
     va_end(argptr);
 
-    printf("\n");
+    fprintf(out, "\n");
 
-    longjmp(error_jmp, 1);
+    longjmp(interp->error_jmp, 1);
 }
 
-void parse_free_all() {
-    for (int i = 0; i < allocated_objs; i++)
-        free(ptr_array[i]);
+/*! Copies `len` chars of a string into the parse arena, NUL-terminated,
+    returning its offset. */
+uint32_t parse_string_dup(Interp *interp, const char *str, size_t len) {
+    uint32_t used = interp->strings_used;
+
+    if (used + len + 1 > interp->strings_size) {
+        do {
+            interp->strings_size = interp->strings_size == 0 ?
+                                   PARSE_STRINGS_SIZE :
+                                   interp->strings_size * 2;
+        } while (used + len + 1 > interp->strings_size);
+
+        interp->parse_strings = realloc(interp->parse_strings,
+                                        interp->strings_size);
 
-    free(ptr_array);
-    ptr_array = NULL;
-    allocated_objs = max_objs = 0;
+        if (interp->parse_strings == NULL) {
+            error(interp, -1, "%s", "Allocation failed!");
+        }
+    }
+
+    memcpy(interp->parse_strings + used, str, len);
+    interp->parse_strings[used + len] = '\0';
+    interp->strings_used += len + 1;
+    return used;
 }
 
-char *parse_string_dup(const char *str) {
-    char *str2 = parse_alloc(sizeof(char) * (strlen(str) + 1));
+/*! FNV-1a, shared by the symbol table and string dict keys. */
+unsigned int hash_string(const char *str) {
+    unsigned int hash = 2166136261u;
 
-    for (size_t i = 0; i < strlen(str) + 1; i++)
-        str2[i] = str[i];
+    for (const char *c = str; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char) *c) * 16777619u;
+    }
+
+    return hash;
+}
+
+/*! FNV-1a over `len` bytes, for text that isn't NUL-terminated. */
+unsigned int hash_bytes(const char *str, size_t len) {
+    unsigned int hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char) str[i]) * 16777619u;
+    }
 
-    return str2;
+    return hash;
 }
@@ -10,10 +10,11 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <setjmp.h>
 
-/*! Maximum length of a single token. */
-#define MAX_LENGTH 512
+/*! Initial size of the parse arena's string buffer. */
+#define PARSE_STRINGS_SIZE 512
 
 /*! Default initial size for realloc-growing arrays. */
 #define INITIAL_SIZE 8
@@ -22,13 +23,15 @@
 #define UNREACHABLE() \
   { fprintf(stderr, "THIS SHOULD BE UNREACHABLE!"); exit(-1); }
 
-void *parse_alloc(size_t sz);
-void parse_free_all();
-char *parse_string_dup(const char *str);
+/*! An interpreter session; see interp.h. */
+typedef struct Interp Interp;
+
+unsigned int hash_string(const char *str);
+unsigned int hash_bytes(const char *str, size_t len);
 
 //TODO: where do I put this???
-void error(int pos, const char *fmt, ...) __attribute__((noreturn));
-extern sigjmp_buf error_jmp;
+void error(Interp *interp, int pos, const char *fmt, ...)
+    __attribute__((noreturn));
 
 /********************* PARSE TYPES *********************/
 
@@ -70,8 +73,9 @@ typedef enum TokenType {
 typedef struct Token {
     TokenType type;
     int pos;
-    char string[MAX_LENGTH];
-    int int_value;
+    /*! The token's text, as a slice of the line: excludes a string's
+        quotes. */
+    int start, length;
     float float_value;
 } Token;
 
@@ -81,12 +85,19 @@ typedef enum StatementType {
     STMT_GC
 } StatementType;
 
+/*! Index of an expression in the parse arena's node array. */
+typedef uint32_t ExprId;
+
+/*! No expression, e.g. the `next` of the last item in a literal. */
+#define NO_EXPR ((ExprId) -1)
+
 typedef struct ParseStatement {
     enum StatementType type;
 
     union {
-        struct ParseExpression *expr;
-        char *identifier;
+        ExprId expr;
+        /*! Offset of the name in the parse arena's string buffer. */
+        uint32_t identifier;
     };
 } ParseStatement;
 
@@ -105,28 +116,38 @@ typedef enum ExpressionType {
     EXPR_DIV
 } ExpressionType;
 
+/*!
+ * An expression node.  Nodes refer to each other by ExprId rather than by
+ * pointer, since the node array may move as it grows.  The items of a list
+ * literal are chained through `next`, starting at `items.first`; a dict
+ * literal chains key, value, key, value, ... the same way, with
+ * `items.length` counting the pairs.
+ */
 typedef struct ParseExpression {
     enum ExpressionType type;
+    ExprId next;
 
     union {
         struct {
-            struct ParseExpression *lhs, *rhs;
+            ExprId lhs, rhs;
         };
-        char *string;
+        /*! Offset of a name in the parse arena's string buffer. */
+        uint32_t string;
+        /*! A string literal's text, as a slice of the statement's line. */
+        struct {
+            uint32_t start, length;
+        } slice;
         float float_value;
-        struct ParseListNode *list;
-        struct ParseDictNode *dict;
+        struct {
+            ExprId first;
+            uint32_t length;
+        } items;
     };
 } ParseExpression;
 
-typedef struct ParseListNode {
-    struct ParseListNode *next;
-    struct ParseExpression *expr;
-} ParseListNode;
-
-typedef struct ParseDictNode {
-    struct ParseDictNode *next;
-    struct ParseExpression *key, *value;
-} ParseDictNode;
+/* The parse arena, kept in the Interp; see parse_expr() in interp.h. */
+ExprId parse_new_expr(Interp *interp, ExpressionType type);
+uint32_t parse_string_dup(Interp *interp, const char *str, size_t len);
+void parse_reset(Interp *interp);
 
 #endif /* GLOBAL_H */
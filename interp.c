@@ -0,0 +1,182 @@
+/*! \file
+ * Creating and destroying interpreter sessions, and running statements in
+ * them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "interp.h"
+#include "bgsweep.h"
+#include "bytecode.h"
+#include "gc.h"
+#include "myalloc.h"
+#include "parmark.h"
+#include "parse.h"
+#include "vm.h"
+
+/*! Creates a session with an empty heap and no globals, printing to `out`.
+    Returns NULL if the memory for it can't be had. */
+Interp *interp_create(FILE *out) {
+    Interp *interp = calloc(1, sizeof(Interp));
+
+    if (interp == NULL) {
+        return NULL;
+    }
+
+    interp->out = out;
+    interp->free_refs = -1;
+    interp->free_vars = -1;
+
+    if (!init_myalloc(interp)) {
+        free(interp);
+        return NULL;
+    }
+
+    return interp;
+}
+
+/*! Releases a session and everything it allocated. */
+void interp_destroy(Interp *interp) {
+    parallel_mark_destroy(interp);
+    bgsweep_destroy(interp);
+    close_myalloc(interp);
+    code_cache_clear(interp);
+
+    for (int i = 0; i < interp->num_vars; i++) {
+        free(interp->global_vars[i].name);
+    }
+
+    free(interp->global_vars);
+    free(interp->var_index);
+    free(interp->ref_table);
+    free(interp->temp_roots);
+    free(interp->mark_stack);
+    free(interp->young_refs);
+    free(interp->remembered);
+    free(interp->vm_stack);
+    free(interp->code_cache);
+    free(interp->code_seen);
+    free(interp->parse_nodes);
+    free(interp->parse_strings);
+    free(interp->print_buf.data);
+    free(interp);
+}
+
+/*! The time in seconds, for profiling. */
+double phase_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*! read(), timing the statement's parsing.  bump_token() times the lexing
+    it does along the way, which is taken back out. */
+static ParseStatement *profile_read(Interp *interp, const char *text) {
+    double start = phase_clock();
+    double lexed = interp->phase_times.lex;
+    ParseStatement *stmt = read(interp, text);
+
+    interp->phase_times.parse += phase_clock() - start -
+                                 (interp->phase_times.lex - lexed);
+    return stmt;
+}
+
+/*!
+ * Parses, compiles and runs the statement on the first line of `text`,
+ * optionally dumping the heap afterwards.  A line that has been compiled
+ * before runs its cached code instead.  Errors are reported and skip the
+ * rest of the line.  Returns where the next line starts.
+ */
+const char *interp_run_statement(Interp *interp, const char *text,
+                                 bool dump) {
+    /* Volatile, since they're assigned after setjmp and used after longjmp.
+     * `fresh` is code being compiled, not yet handed to the cache. */
+    Code *volatile fresh = NULL;
+    const char *volatile next = NULL;
+    size_t length = strcspn(text, "\n");
+    unsigned int hash = hash_bytes(text, length);
+
+    if (setjmp(interp->error_jmp)) {
+        goto free_statement;
+    }
+
+    Code *code = code_cache_find(interp, text, length, hash);
+    double start = 0;
+
+    if (code != NULL) {
+        /* Errors still report the line being run. */
+        interp->lex_string = text;
+        next = text[length] == '\n' ? text + length + 1 : text + length;
+
+        if (interp->profile) {
+            start = phase_clock();
+        }
+    } else {
+        ParseStatement *stmt = interp->profile ? profile_read(interp, text)
+                                               : read(interp, text);
+        next = read_end(interp);
+
+        if (stmt == NULL) {
+            goto free_statement;
+        }
+
+        if (interp->profile) {
+            start = phase_clock();
+        }
+
+        fresh = new_code(interp, text, length, hash);
+        compile_statement(interp, stmt, fresh);
+        code = fresh;
+
+        if (code_cache_offer(interp, fresh)) {
+            fresh = NULL;
+        }
+    }
+
+    interp->statements_run++;
+
+    /* Printing, which happens during the run, is timed by print_ref(). */
+    double printed = interp->phase_times.print;
+
+    run_code(interp, code);
+
+    if (interp->profile) {
+        interp->phase_times.eval += phase_clock() - start -
+                                    (interp->phase_times.print - printed);
+    }
+
+    if (dump) {
+        memdump(interp);
+    }
+
+    /* The statement's temporaries are garbage now, so let them go before
+     * the collector's step between statements. */
+    gc_clear_temporaries(interp);
+    myalloc_collect_step(interp);
+
+free_statement:
+    if (fresh != NULL) {
+        free_code(fresh);
+    }
+    parse_reset(interp);
+    gc_clear_temporaries(interp);
+    /* The text is the caller's, and may be gone by the next error. */
+    interp->lex_string = NULL;
+
+    if (next == NULL) {
+        next = strchr(text, '\n');
+        next = next == NULL ? text + strlen(text) : next + 1;
+    }
+
+    return next;
+}
+
+/*! Runs every statement in a NUL-terminated script. */
+void interp_run_script(Interp *interp, const char *text) {
+    for (const char *next = text; *next != '\0'; ) {
+        next = interp_run_statement(interp, next, false);
+    }
+}
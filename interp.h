@@ -0,0 +1,184 @@
+/*! \file
+ * The interpreter context.  Everything a session of the interpreter mutates
+ * lives here rather than in file-scope globals, and is passed explicitly to
+ * every function that touches it, so that one process can host many
+ * independent sessions, each on whichever thread runs it.
+ */
+
+#ifndef INTERP_H
+#define INTERP_H
+
+#include <setjmp.h>
+#include <stdio.h>
+
+#include "global.h"
+#include "eval.h"
+#include "myalloc.h"
+#include "symtab.h"
+#include "print.h"
+
+/*! Room for the message of the latest error, which is cut short to fit. */
+#define ERROR_MESSAGE_SIZE 256
+
+/*! Seconds spent in each phase of running statements, while profiling.
+    Parsing excludes the lexing it does, and evaluation the printing. */
+typedef struct PhaseTimes {
+    double lex, parse, eval, print;
+} PhaseTimes;
+
+struct Interp {
+    /* Errors: error() reports to `out`, then longjmp()s to error_jmp. */
+    sigjmp_buf error_jmp;
+    /*! Errors raised so far, and the message of the latest one. */
+    long errors;
+    char error_message[ERROR_MESSAGE_SIZE];
+    /*! Where printed values, errors and collector reports go; NULL discards
+        them. */
+    FILE *out;
+    /*! Statements parsed so far. */
+    long statements_run;
+    /*! Whether to time the phases of each statement into phase_times. */
+    bool profile;
+    PhaseTimes phase_times;
+
+    /* The reference table (eval.c). */
+    struct Reference *ref_table;
+    int num_refs, max_refs;
+    /*! Head of the list of released slots below num_refs, linked through
+        Reference.next_free; -1 when empty. */
+    RefId free_refs;
+    /*! The most slots the table has had in use at once. */
+    int peak_refs;
+
+    /* The heap (myalloc.c). */
+    struct Region *regions;
+    int num_regions, max_regions;
+    /*! The region bump allocation currently happens in; all later ones are
+        empty, unless BACKGROUND_SWEEP left holes in them. */
+    int alloc_region;
+    /*! Free bytes below the regions' freeptrs, in blocks a background sweep
+        freed. */
+    size_t hole_bytes;
+    /*! The color that marks a block live, flipped as each full collection
+        starts marking; see BACKGROUND_SWEEP. */
+    bool block_color;
+    /*! Total bytes mapped across all regions. */
+    size_t heap_size;
+    /*! The most bytes the nursery and regions have had in use at once, as
+        of the last collection; see myalloc_note_peak(). */
+    size_t peak_used;
+    /*! Bytes that may be allocated before collecting early, and the bytes
+        allocated since the last collection. */
+    size_t alloc_budget, allocated_since_gc;
+    /*! Where young refs' blocks are bump-allocated, apart from the regions
+        and not counted in heap_size; unmapped (start NULL) when the heap
+        is a single generation. */
+    struct Region nursery;
+
+    /* The collector (gc.c). */
+    /*! References created by the statement currently being evaluated.  The
+        evaluator holds them only in C locals, so a collection triggered from
+        inside myalloc() must treat them as roots alongside the globals. */
+    RefId *temp_roots;
+    int num_temp_roots, max_temp_roots;
+    /*! Explicit mark stack, so deeply nested values don't recurse once per
+        level. */
+    RefId *mark_stack;
+    int mark_top, mark_max;
+    /*! The young generation: refs created since the last collection, in
+        the order they were. */
+    RefId *young_refs;
+    int num_young, max_young;
+    /*! Old lists and dicts that a young value has been stored into since the
+        last collection; see gc_write_barrier(). */
+    RefId *remembered;
+    int num_remembered, max_remembered;
+    /*! True while an incremental full collection is marking; mark_stack
+        then holds its grey refs. */
+    bool marking;
+    /*! How many of global_vars its steps have shaded, and the list or dict
+        one of them left part traced (-1 if none), with the index of the
+        first item or entry still to mark. */
+    int globals_shaded;
+    RefId mark_resume;
+    int mark_resume_at;
+    /*! Collections so far: minor ones of the young generation alone, and
+        full ones, and the incremental steps taken towards the latter. */
+    long minor_collections, full_collections, mark_steps;
+    /*! The longest the collector has held up the mutator, in seconds: in a
+        minor collection or incremental step, and in a full collection or
+        the final pause of an incremental one. */
+    double max_gc_pause, max_final_pause;
+    /*! The parallel marker's threads, once started (parmark.c). */
+    struct MarkPool *mark_pool;
+    /*! The background sweeper (bgsweep.c), and whether it is sweeping.  The
+        regions in [unswept_begin, unswept_end) are still its own. */
+    struct Sweeper *sweeper;
+    bool sweeping;
+    int unswept_begin, unswept_end;
+
+    /* The symbol table (symtab.c). */
+    /*! Records [0, num_vars) have been handed out at least once. */
+    struct GlobalVariable *global_vars;
+    int num_vars, max_vars;
+    /*! Head of the list of deleted records, linked through next_free. */
+    int free_vars;
+    /*! Hash index over the records; see symtab.c. */
+    int *var_index;
+    int index_capacity, index_used;
+    /*! Bumped by every deletion, to invalidate slots cached in GlobalRefs. */
+    unsigned int symtab_epoch;
+
+    /* The VM (vm.c). */
+    /*! The value stack.  Values on it are only held by the VM, so the
+        collector treats [vm_stack, vm_sp) as roots; the VM keeps vm_sp
+        current whenever it calls something that may allocate. */
+    RefId *vm_stack, *vm_sp;
+    int vm_stack_size;
+
+    /* The parse arena (global.c): every statement's expressions live in one
+     * contiguous node array, and their strings in one character buffer; both
+     * are bump-allocated and reset in O(1) before the next statement. */
+    ParseExpression *parse_nodes;
+    uint32_t num_nodes, max_nodes;
+    char *parse_strings;
+    uint32_t strings_used, strings_size;
+
+    /* The lexer and parser (parse.c). */
+    /*! The text being lexed; tokens are slices of it. */
+    const char *lex_string;
+    int lex_pos;
+    Token curr_token;
+    /*! The statement most recently read. */
+    ParseStatement curr_stmt;
+
+    /* The compiler (compile.c). */
+    /*! Running stack depth while compiling, to size the VM's stack. */
+    int stack_depth;
+    /*! Compiled lines, by their text, and the hashes of lines compiled once;
+        see compile.c. */
+    struct Code **code_cache;
+    int code_cache_used;
+    unsigned int *code_seen;
+
+    /* The printer (print.c). */
+    OutBuf print_buf;
+};
+
+Interp *interp_create(FILE *out);
+void interp_destroy(Interp *interp);
+const char *interp_run_statement(Interp *interp, const char *text, bool dump);
+void interp_run_script(Interp *interp, const char *text);
+double phase_clock(void);
+
+/*! Looks up a node. Pointers are only good until the next node is added. */
+static inline ParseExpression *parse_expr(Interp *interp, ExprId id) {
+    return &interp->parse_nodes[id];
+}
+
+/*! Looks up a string stored with parse_string_dup(). */
+static inline const char *parse_string(Interp *interp, uint32_t offset) {
+    return &interp->parse_strings[offset];
+}
+
+#endif /* INTERP_H */
@@ -0,0 +1,115 @@
+/*! \file
+ * Measures lexing throughput on a generated script with long string literals,
+ * whitespace-aligned assignments and long identifiers.
+ *
+ * Usage: lexbench [megabytes to lex, default 256]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "global.h"
+#include "interp.h"
+#include "parse.h"
+#include "scan.h"
+
+#define NUM_LINES 1024
+
+/*! Builds the i'th line of the script. */
+static char *make_line(int i) {
+    char *line = malloc(8192);
+    int len = 0;
+
+    if (line == NULL) {
+        fprintf(stderr, "Allocation failed!\n");
+        exit(1);
+    }
+
+    switch (i % 4) {
+        case 0:
+            /* A multi-kilobyte string literal. */
+            len += sprintf(line, "text_%d = \"", i);
+            memset(line + len, 'a' + i % 26, 4000);
+            len += 4000;
+            strcpy(line + len, "\"\n");
+            break;
+        case 1:
+            sprintf(line, "a_rather_long_variable_name_number_%d"
+                    "                                = %d.25 * another_"
+                    "long_identifier_for_the_benchmark\n", i, i);
+            break;
+        case 2:
+            sprintf(line, "table_%d = {\"key\":    [1,    2,    3],    "
+                    "\"other_key\":    'value'}\n", i);
+            break;
+        default:
+            sprintf(line, "                        result_%d[%d]   =   "
+                    "(left_hand_side + right_hand_side) / 2\n", i, i);
+            break;
+    }
+
+    return line;
+}
+
+/*! Lexes the lines over and over until at least `target_bytes` have gone
+    by, adding the bytes and tokens lexed to `*bytes` and `*tokens`.  Returns
+    false if lexing raised an error. */
+static bool lex_lines(Interp *interp, char **lines, size_t script_bytes,
+                      double target_bytes, size_t *bytes, long *tokens) {
+    if (setjmp(interp->error_jmp)) {
+        return false;
+    }
+
+    while (*bytes < target_bytes) {
+        for (int i = 0; i < NUM_LINES; i++) {
+            *tokens += lex_line(interp, lines[i]);
+        }
+
+        *bytes += script_bytes;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    double target_mb = argc > 1 ? atof(argv[1]) : 256;
+    char *lines[NUM_LINES];
+    size_t script_bytes = 0, bytes = 0;
+    long tokens = 0;
+    struct timespec start, end;
+    Interp *interp = interp_create(stdout);
+
+    if (interp == NULL) {
+        fprintf(stderr, "Could not create an interpreter.\n");
+        return 1;
+    }
+
+    for (int i = 0; i < NUM_LINES; i++) {
+        lines[i] = make_line(i);
+        script_bytes += strlen(lines[i]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!lex_lines(interp, lines, script_bytes, target_mb * 1024 * 1024,
+                   &bytes, &tokens)) {
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec) +
+                  (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("lex (%s): %.1f MB in %.3f s, %.1f MB/s, %.1f M tokens/s\n",
+           scan_isa(), bytes / 1048576.0, secs, bytes / 1048576.0 / secs,
+           tokens / 1e6 / secs);
+
+    for (int i = 0; i < NUM_LINES; i++) {
+        free(lines[i]);
+    }
+
+    interp_destroy(interp);
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*! \file
+ * The list value type: a growable array of element RefIds kept in the managed
+ * pool, so indexing and length are O(1) and appends are amortized O(1).
+ */
+
+#include <string.h>
+
+#include "global.h"
+#include "eval.h"
+#include "interp.h"
+#include "list.h"
+#include "myalloc.h"
+#include "gc.h"
+
+/*!
+ * Allocates an element array with room for `capacity` items for `list`,
+ * copying over the items of its current array (if any), and installs it.  The
+ * old block is left for the collector, which drops it since the ref no longer
+ * points at it.
+ */
+static void list_resize(Interp *interp, RefId list, int capacity) {
+    ListArray *array = myalloc(interp,
+                               sizeof(ListArray) + sizeof(RefId) * capacity,
+                               list);
+
+    /* myalloc may have compacted the pool, so fetch the old array only now. */
+    ListArray *old = deref(interp, list)->type == VAL_LIST ?
+                     deref(interp, list)->list : NULL;
+
+    array->length = 0;
+    array->capacity = capacity;
+
+    if (old != NULL) {
+        memcpy(array->items, old->items, sizeof(RefId) * old->length);
+        array->length = old->length;
+    }
+
+    deref(interp, list)->type = VAL_LIST;
+    deref(interp, list)->list = array;
+}
+
+/*! Allocates an empty list with room for at least `min_capacity` items. */
+RefId make_reference_list(Interp *interp, int min_capacity) {
+    RefId r = make_reference(interp);
+    list_resize(interp, r, min_capacity > 0 ? min_capacity : INITIAL_SIZE);
+    return r;
+}
+
+/*! Appends `value` to `list`, doubling its array when it is full. */
+void list_append(Interp *interp, RefId list, RefId value) {
+    ListArray *array = deref(interp, list)->list;
+
+    if (array->length == array->capacity) {
+        list_resize(interp, list, array->capacity * 2);
+        array = deref(interp, list)->list;
+    }
+
+    array->items[array->length++] = value;
+    gc_write_barrier(interp, list, value);
+}
+
+/*!
+ * Returns the slot of the `idx`th item of `list`, erroring if it is out of
+ * bounds.  The pointer is into the pool, so it must be used before anything
+ * else is allocated.
+ */
+RefId *list_get_lval(Interp *interp, RefId list, int idx) {
+    ListArray *array = deref(interp, list)->list;
+
+    if (idx < 0 || idx >= array->length) {
+        error(interp, -1, "Index out of bounds: %d out of %d.", idx,
+              array->length);
+    }
+
+    return &array->items[idx];
+}
@@ -0,0 +1,25 @@
+/*! \file
+ * Declarations for the array-backed list value type.
+ */
+
+#ifndef LIST_H
+#define LIST_H
+
+#include "eval.h"
+
+/*!
+ * A list's elements, stored contiguously as a single pool block owned by the
+ * list's reference.  `items` has room for `capacity` RefIds, of which the
+ * first `length` are in use.
+ */
+typedef struct ListArray {
+    int length;
+    int capacity;
+    RefId items[];
+} ListArray;
+
+RefId make_reference_list(Interp *interp, int min_capacity);
+void list_append(Interp *interp, RefId list, RefId value);
+RefId *list_get_lval(Interp *interp, RefId list, int idx);
+
+#endif /* LIST_H */
@@ -0,0 +1,151 @@
+/*! \file
+ * Times the mark phase of a full collection over a large synthetic heap, on
+ * 1, 2, 4, 8 and 16 threads, and reports each one's speedup over marking
+ * serially.  The heap is one global list of lists, each holding a few strings
+ * and a small dict, about a million refs in all by default.
+ *
+ * Usage: markbench [--lists N] [--max-threads N]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "global.h"
+#include "interp.h"
+#include "dict.h"
+#include "gc.h"
+#include "list.h"
+#include "myalloc.h"
+#include "symtab.h"
+
+/*! Strings in each of the heap's lists, besides its dict. */
+#define STRINGS_PER_LIST 8
+
+/*! Lists built between clearing the temporaries that allocation roots. */
+#define BUILD_BATCH 256
+
+/*! Collections per thread count; the fastest mark counts. */
+#define REPETITIONS 5
+
+/*! Stores `value` under `key` in `dict`. */
+static void store(Interp *interp, RefId dict, const char *key, RefId value) {
+    RefId key_ref = make_reference_string(interp, (char *) key);
+
+    *dict_get_lval(interp, dict, key_ref) = value;
+    gc_write_barrier(interp, dict, value);
+}
+
+/*! Binds the global `heap` to `num_lists` lists of strings and a dict. */
+static void build_heap(Interp *interp, int num_lists) {
+    RefId heap = make_reference_list(interp, num_lists);
+
+    *get_global_variable(interp, (char *) "heap", true) = heap;
+    for (int i = 0; i < num_lists; i++) {
+        RefId list = make_reference_list(interp, STRINGS_PER_LIST + 1);
+
+        list_append(interp, heap, list);
+        for (int s = 0; s < STRINGS_PER_LIST; s++) {
+            list_append(interp, list, make_reference_string(interp, "item"));
+        }
+
+        RefId dict = make_reference_dict(interp, 2);
+
+        list_append(interp, list, dict);
+        store(interp, dict, "index", make_reference_float(i));
+        store(interp, dict, "name", make_reference_string(interp, "node"));
+
+        if (i % BUILD_BATCH == 0) {
+            gc_clear_temporaries(interp);
+        }
+    }
+    gc_clear_temporaries(interp);
+}
+
+/*! Collects over and over on each number of threads, printing the fastest
+    mark of each. */
+static void measure(Interp *interp, int max_threads) {
+    double serial_ms = 0;
+
+    printf("%d live refs\n", interp->num_refs);
+    printf("threads  mark ms  speedup\n");
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double best = 0;
+
+        GC_MARK_THREADS = threads;
+        for (int rep = 0; rep < REPETITIONS; rep++) {
+            double secs = collect_garbage(interp).mark_seconds;
+
+            if (rep == 0 || secs < best) {
+                best = secs;
+            }
+        }
+
+        if (threads == 1) {
+            serial_ms = best * 1e3;
+        }
+        printf("%7d  %7.2f  %6.2fx\n", threads, best * 1e3,
+               serial_ms / (best * 1e3));
+        fflush(stdout);
+    }
+}
+
+/*! Builds the heap and measures marking it. */
+static int run(int num_lists, int max_threads) {
+    /* Every collection is a whole stop-the-world mark. */
+    GC_PAUSE_BUDGET_US = 0;
+
+    Interp *interp = interp_create(NULL);
+
+    if (interp == NULL) {
+        fprintf(stderr, "Could not create an interpreter.\n");
+        return 1;
+    }
+
+    if (setjmp(interp->error_jmp)) {
+        fprintf(stderr, "%s\n", interp->error_message);
+        return 1;
+    }
+
+    build_heap(interp, num_lists);
+    collect_garbage(interp);
+    measure(interp, max_threads);
+
+    interp_destroy(interp);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--lists N] [--max-threads N]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"lists", required_argument, NULL, 'l'},
+        {"max-threads", required_argument, NULL, 't'},
+        {NULL, 0, NULL, 0}
+    };
+    int num_lists = 100000, max_threads = 16;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'l':
+                num_lists = atoi(optarg);
+                break;
+            case 't':
+                max_threads = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc || num_lists < 1 || max_threads < 1) {
+        usage(argv[0]);
+    }
+
+    return run(num_lists, max_threads);
+}
@@ -0,0 +1,454 @@
+/*! \file
+ * Times the interpreter's hot paths one at a time, each in a fresh session:
+ * allocation, list subscripts, dict lookup and insertion, global lookup,
+ * lexing, parsing, printing and collection.  Results are written to stdout as
+ * JSON; given a saved baseline, any benchmark that got slower by more than
+ * the threshold is reported on stderr, and the exit status is 1.
+ *
+ * Usage: microbench [--compare BASELINE.json] [--threshold PERCENT]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "global.h"
+#include "interp.h"
+#include "dict.h"
+#include "gc.h"
+#include "list.h"
+#include "parse.h"
+#include "print.h"
+#include "symtab.h"
+
+/*! Elements in the list, keys in the dict and names in the symbol table that
+    the lookup benchmarks cycle through. */
+#define TABLE_SIZE 4096
+
+/*! Operations between clearing the temporaries that allocation roots. */
+#define ALLOC_BATCH 1024
+
+/*! Live lists (of a string and a float each) in the collector's heap. */
+#define GC_LIVE_LISTS 50000
+
+/*! Each timed run is scaled up until it takes at least this long. */
+#define MIN_RUN_SECONDS 0.05
+
+/*! Timed runs per benchmark; the fastest counts. */
+#define REPETITIONS 5
+
+/*! Sample statements for the lexing and parsing benchmarks. */
+static const char *const script_lines[] = {
+    "total = total + prices[index] * 1.0825\n",
+    "inventory = {'apples': [1, 2, 3], 'pears': 12.5, 'name': 'fruit'}\n",
+    "matrix[3][4] = (left_hand_side - right_hand_side) / 2\n",
+    "message = 'the quick brown fox jumps over the lazy dog'\n",
+    "del temporary_result\n",
+};
+
+#define NUM_SCRIPT_LINES \
+    ((int) (sizeof(script_lines) / sizeof(script_lines[0])))
+
+/*! The names the global lookup benchmark binds and looks up. */
+static char global_names[TABLE_SIZE][16];
+
+/*! The name of the i'th global the benchmarks bind. */
+static void global_name(char *buf, int i) {
+    sprintf(buf, "global_%d", i);
+}
+
+/*! Binds a value to a global, which keeps it alive across collections. */
+static void bind(Interp *interp, const char *name, RefId value) {
+    *get_global_variable(interp, (char *) name, true) = value;
+}
+
+static RefId lookup(Interp *interp, const char *name) {
+    return *get_global_variable(interp, (char *) name, false);
+}
+
+//// BENCHMARKS ////
+
+static size_t run_alloc(Interp *interp, long n) {
+    for (long i = 0; i < n; i++) {
+        make_reference_string(interp, "a freshly allocated string");
+
+        if (i % ALLOC_BATCH == ALLOC_BATCH - 1) {
+            gc_clear_temporaries(interp);
+        }
+    }
+
+    gc_clear_temporaries(interp);
+    return 0;
+}
+
+static void setup_list(Interp *interp) {
+    RefId list = make_reference_list(interp, TABLE_SIZE);
+
+    bind(interp, "list", list);
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        list_append(interp, list, make_reference_float(i));
+    }
+    gc_clear_temporaries(interp);
+}
+
+static size_t run_list_subscript(Interp *interp, long n) {
+    RefId list = lookup(interp, "list");
+    float sum = 0;
+
+    for (long i = 0; i < n; i++) {
+        sum += ref_float(*list_get_lval(interp, list,
+                                        (i * 7) % TABLE_SIZE));
+    }
+
+    return sum < 0;
+}
+
+static void setup_dict(Interp *interp) {
+    RefId dict = make_reference_dict(interp, TABLE_SIZE);
+    RefId keys = make_reference_list(interp, TABLE_SIZE);
+    char key[32];
+
+    bind(interp, "dict", dict);
+    bind(interp, "keys", keys);
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        global_name(key, i);
+        list_append(interp, keys, make_reference_string(interp, key));
+        *dict_get_lval(interp, dict, deref(interp, keys)->list->items[i]) =
+            make_reference_float(i);
+    }
+    gc_clear_temporaries(interp);
+}
+
+static size_t run_dict_lookup(Interp *interp, long n) {
+    RefId dict = lookup(interp, "dict");
+    RefId keys = lookup(interp, "keys");
+    long found = 0;
+
+    for (long i = 0; i < n; i++) {
+        RefId key = deref(interp, keys)->list->items[(i * 7) % TABLE_SIZE];
+        found += dict_get(interp, dict, key) != -1;
+    }
+
+    return found < 0;
+}
+
+static size_t run_dict_insert(Interp *interp, long n) {
+    RefId dict = -1;
+
+    for (long i = 0; i < n; i++) {
+        /* Start over with an empty dict, so it doesn't grow without end. */
+        if (i % TABLE_SIZE == 0) {
+            dict = make_reference_dict(interp, 0);
+            bind(interp, "dict", dict);
+            gc_clear_temporaries(interp);
+        }
+
+        *dict_get_lval(interp, dict, make_reference_float(i % TABLE_SIZE)) =
+            make_reference_float(i);
+    }
+
+    return 0;
+}
+
+static void setup_globals(Interp *interp) {
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        global_name(global_names[i], i);
+        bind(interp, global_names[i], make_reference_float(i));
+    }
+}
+
+static size_t run_global_lookup(Interp *interp, long n) {
+    float sum = 0;
+
+    for (long i = 0; i < n; i++) {
+        sum += ref_float(lookup(interp, global_names[(i * 7) % TABLE_SIZE]));
+    }
+
+    return sum < 0;
+}
+
+static size_t run_lex(Interp *interp, long n) {
+    size_t bytes = 0;
+
+    for (long i = 0; i < n; i++) {
+        const char *line = script_lines[i % NUM_SCRIPT_LINES];
+
+        lex_line(interp, line);
+        bytes += strlen(line);
+    }
+
+    return bytes;
+}
+
+static size_t run_parse(Interp *interp, long n) {
+    size_t bytes = 0;
+
+    for (long i = 0; i < n; i++) {
+        const char *line = script_lines[i % NUM_SCRIPT_LINES];
+
+        read(interp, line);
+        parse_reset(interp);
+        bytes += strlen(line);
+    }
+
+    return bytes;
+}
+
+static void setup_print(Interp *interp) {
+    RefId value = make_reference_dict(interp, 4);
+    RefId list = make_reference_list(interp, 8);
+
+    bind(interp, "value", value);
+    for (int i = 0; i < 8; i++) {
+        list_append(interp, list, make_reference_float(i * 1.25f - 3));
+    }
+    *dict_get_lval(interp, value, make_reference_string(interp, "items")) =
+        list;
+    gc_write_barrier(interp, value, list);
+    /* Allocate before taking the slot, which allocation may move. */
+    RefId name = make_reference_string(interp, "a printed value");
+    *dict_get_lval(interp, value, make_reference_string(interp, "name")) =
+        name;
+    gc_write_barrier(interp, value, name);
+    *dict_get_lval(interp, value, make_reference_float(0.1f)) =
+        make_reference_float(1e-7f);
+    gc_clear_temporaries(interp);
+}
+
+static size_t run_print(Interp *interp, long n) {
+    RefId value = lookup(interp, "value");
+    OutBuf *buf = &interp->print_buf;
+    size_t bytes = 0;
+
+    for (long i = 0; i < n; i++) {
+        format_ref(interp, buf, value, MAX_DEPTH);
+        bytes += buf->length;
+        buf->length = 0;
+    }
+
+    return bytes;
+}
+
+static void setup_gc(Interp *interp) {
+    RefId lists = make_reference_list(interp, GC_LIVE_LISTS);
+
+    bind(interp, "lists", lists);
+    for (int i = 0; i < GC_LIVE_LISTS; i++) {
+        RefId list = make_reference_list(interp, 2);
+
+        list_append(interp, lists, list);
+        list_append(interp, list, make_reference_string(interp, "live"));
+        list_append(interp, list, make_reference_float(i));
+
+        if (i % ALLOC_BATCH == 0) {
+            gc_clear_temporaries(interp);
+        }
+    }
+    gc_clear_temporaries(interp);
+}
+
+static size_t run_gc(Interp *interp, long n) {
+    for (long i = 0; i < n; i++) {
+        collect_garbage(interp);
+    }
+
+    return 0;
+}
+
+typedef struct Benchmark {
+    const char *name;
+    /*! Builds the data the benchmark works on; may be NULL. */
+    void (*setup)(Interp *interp);
+    /*! Performs n operations, returning the bytes they processed, if that's
+        a meaningful measure, or 0. */
+    size_t (*run)(Interp *interp, long n);
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"alloc_string", NULL, run_alloc},
+    {"list_subscript", setup_list, run_list_subscript},
+    {"dict_lookup", setup_dict, run_dict_lookup},
+    {"dict_insert", NULL, run_dict_insert},
+    {"global_lookup", setup_globals, run_global_lookup},
+    {"lex", NULL, run_lex},
+    {"parse", NULL, run_parse},
+    {"print", setup_print, run_print},
+    {"gc_pause", setup_gc, run_gc},
+};
+
+#define NUM_BENCHMARKS ((int) (sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+//// HARNESS ////
+
+typedef struct Result {
+    long ops;
+    double ns_per_op;
+    /*! 0 unless the benchmark counts bytes. */
+    double mb_per_s;
+} Result;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*! Scales a benchmark up to MIN_RUN_SECONDS, then keeps its fastest run. */
+static Result measure(const Benchmark *bench) {
+    Interp *interp = interp_create(NULL);
+    Result result = { .ops = 1, .ns_per_op = 0, .mb_per_s = 0 };
+
+    if (interp == NULL) {
+        fprintf(stderr, "Could not create an interpreter.\n");
+        exit(1);
+    }
+
+    if (setjmp(interp->error_jmp)) {
+        fprintf(stderr, "%s: %s\n", bench->name, interp->error_message);
+        exit(1);
+    }
+
+    if (bench->setup != NULL) {
+        bench->setup(interp);
+    }
+
+    double start = now();
+
+    bench->run(interp, result.ops);
+    while (now() - start < MIN_RUN_SECONDS) {
+        result.ops *= 2;
+        start = now();
+        bench->run(interp, result.ops);
+    }
+
+    for (int rep = 0; rep < REPETITIONS; rep++) {
+        start = now();
+        size_t bytes = bench->run(interp, result.ops);
+        double secs = now() - start;
+        double ns_per_op = secs * 1e9 / result.ops;
+
+        if (rep == 0 || ns_per_op < result.ns_per_op) {
+            result.ns_per_op = ns_per_op;
+            result.mb_per_s = bytes / 1048576.0 / secs;
+        }
+    }
+
+    interp_destroy(interp);
+    return result;
+}
+
+/*! Finds a benchmark's ns_per_op in a file this program wrote.  Returns
+    false if it isn't there. */
+static bool baseline_ns(const char *json, const char *name, double *ns) {
+    char pattern[64];
+
+    snprintf(pattern, sizeof(pattern), "\"name\": \"%s\"", name);
+    const char *entry = strstr(json, pattern);
+    const char *field = entry == NULL ? NULL : strstr(entry, "\"ns_per_op\":");
+
+    if (field == NULL) {
+        return false;
+    }
+
+    *ns = strtod(field + strlen("\"ns_per_op\":"), NULL);
+    return true;
+}
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "r");
+    char *data = NULL;
+    long size;
+
+    if (file == NULL || fseek(file, 0, SEEK_END) != 0 ||
+        (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0 ||
+        (data = calloc(size + 1, 1)) == NULL ||
+        fread(data, 1, size, file) != (size_t) size) {
+        perror(path);
+        exit(1);
+    }
+
+    fclose(file);
+    return data;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--compare BASELINE.json]"
+            " [--threshold PERCENT]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"compare", required_argument, NULL, 'c'},
+        {"threshold", required_argument, NULL, 't'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *baseline_path = NULL;
+    double threshold = 10;
+    Result results[NUM_BENCHMARKS];
+    int option;
+
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'c':
+                baseline_path = optarg;
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc) {
+        usage(argv[0]);
+    }
+
+    printf("{\n  \"benchmarks\": [\n");
+    for (int i = 0; i < NUM_BENCHMARKS; i++) {
+        results[i] = measure(&benchmarks[i]);
+        printf("    {\"name\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.3f",
+               benchmarks[i].name, results[i].ops, results[i].ns_per_op);
+        if (results[i].mb_per_s != 0) {
+            printf(", \"mb_per_s\": %.1f", results[i].mb_per_s);
+        }
+        printf("}%s\n", i == NUM_BENCHMARKS - 1 ? "" : ",");
+        fflush(stdout);
+    }
+    printf("  ]\n}\n");
+
+    if (baseline_path == NULL) {
+        return 0;
+    }
+
+    char *baseline = read_file(baseline_path);
+    int regressions = 0;
+
+    fprintf(stderr, "%-16s %12s %12s %8s\n", "benchmark", "baseline ns",
+            "current ns", "change");
+    for (int i = 0; i < NUM_BENCHMARKS; i++) {
+        double old_ns;
+
+        if (!baseline_ns(baseline, benchmarks[i].name, &old_ns) ||
+            old_ns <= 0) {
+            fprintf(stderr, "%-16s %12s %12.3f\n", benchmarks[i].name, "-",
+                    results[i].ns_per_op);
+            continue;
+        }
+
+        double change = (results[i].ns_per_op - old_ns) / old_ns * 100;
+        bool regressed = change > threshold;
+
+        fprintf(stderr, "%-16s %12.3f %12.3f %+7.1f%%%s\n", benchmarks[i].name,
+                old_ns, results[i].ns_per_op, change,
+                regressed ? "  REGRESSION" : "");
+        regressions += regressed;
+    }
+
+    free(baseline);
+    return regressions != 0;
+}
@@ -10,113 +10,905 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "myalloc.h"
 #include "eval.h"
+#include "interp.h"
+#include "gc.h"
+#include "global.h"
+#include "bgsweep.h"
 
 
 /*!
- * These variables are used to specify the size and address of the memory pool
- * that the simple allocator works against.  The memory pool is allocated within
- * init_myalloc(), and then myalloc() and free() work against this pool of
- * memory that mem points to.
+ * The heap is a list of regions, each one mmap()ed from the system and each
+ * one a bump region with its own free pointer.  It starts as a single region
+ * of MEMORY_SIZE bytes and grows one region at a time, up to MAX_MEMORY_SIZE
+ * bytes in total.  Regions are filled (and compacted into) in list order, so
+ * after a collection the live data sits at the front of the earliest regions.
  */
-int MEMORY_SIZE;
-unsigned char *mem;
+size_t MEMORY_SIZE = 1 << 20;
+size_t MAX_MEMORY_SIZE = (size_t) 1 << 30;
+
+/*! Whether large regions ask the kernel for transparent huge pages. */
+bool HUGE_PAGES = false;
+
+/*! Regions at least this big are huge-page candidates (and size-rounded). */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/*!
+ * The nursery is a separate bump region of NURSERY_SIZE bytes holding the
+ * blocks of young refs.  When it fills, a minor collection copies the live
+ * ones out into the regions and empties it.  0 disables it, making the heap a
+ * single generation.
+ */
+size_t NURSERY_SIZE = 256 * 1024;
+
+/*! Blocks bigger than this fraction of the nursery go straight into the
+    regions, rather than being copied there by the first minor collection. */
+#define NURSERY_LARGE_FRACTION 4
 
 struct PoolHeader {
     /*! Includes both the size of this header and the data following it. */
-    int obj_size;
-    RefId ref;
+    unsigned int obj_size : 31;
+    /*! Matches interp->block_color while the block is known to be live; see
+        BACKGROUND_SWEEP. */
+    unsigned int color : 1;
+    /*! The owning reference, used to fix up its pointer when compacting.
+        Always a table index, since immediates own no blocks, or FREE_BLOCK. */
+    int ref;
 };
 
+/*! The owner of a block a background sweep has freed. */
+#define FREE_BLOCK (-1)
+
+/*! Free blocks smaller than this can't hold the link to the next, so they
+    are left out of a region's holes until a sweep merges them. */
+#define MIN_HOLE ((int) (sizeof(struct PoolHeader) + sizeof(unsigned char *)))
+
+/*! How many holes an allocation tries before using the region's free end;
+    those smaller than SMALL_HOLE that are too small for it are dropped. */
+#define HOLE_SEARCH 8
+#define SMALL_HOLE 64
+
+/*! The most a single free block covers, to fit obj_size. */
+#define MAX_FREE_RUN ((size_t) 1 << 30)
+
+/*!
+ * Early-collection policy.  After every collection the allocator budgets
+ * GC_TRIGGER_PERCENT percent of the free space that collection left behind;
+ * once that many bytes have been allocated, the next request collects first,
+ * rather than waiting for the heap to run dry.  0 disables early collection.
+ * The budget is never less than MIN_ALLOC_BUDGET, so a heap that can't grow
+ * any more isn't collected on every allocation once it is nearly full.
+ */
+int GC_TRIGGER_PERCENT = 75;
+
+#define MIN_ALLOC_BUDGET 4096
+
+/*!
+ * Incremental collection.  With a pause budget, spending the early-collection
+ * budget starts an incremental full collection rather than a stop-the-world
+ * one.  It then marks for up to GC_PAUSE_BUDGET_US microseconds after every
+ * statement, and after every further 1/MARK_STEP_FRACTION of the heap is
+ * allocated, and finishes once marking is done.  Running out of heap still
+ * finishes it at once.
+ */
+int GC_PAUSE_BUDGET_US = 1000;
+
+/*!
+ * Parallel marking.  With more than one thread, the final pause of a full
+ * collection, which traces whatever the incremental steps didn't, is split
+ * across GC_MARK_THREADS threads (see parmark.c).  Each session starts its
+ * own GC_MARK_THREADS - 1 helpers on its first full collection.
+ */
+int GC_MARK_THREADS = 1;
 
-/* The allocator uses an external "free-pointer" to track
- * where free memory starts.
+/*!
+ * Background sweeping.  Marking colors the block of every ref it reaches
+ * with the collection's color, so a block's header alone says whether it is
+ * live.  Rather than compacting in the pause, a full collection then hands
+ * the regions and reference table to a sweeper thread (see bgsweep.c), which
+ * turns each dead block into a free one in place.  Allocation carries on in
+ * the regions swept so far, reusing their free blocks ("holes") as well as
+ * their ends, and waits on the sweeper only when that isn't enough.  The
+ * heap is never compacted, and the reference table never shrinks.
  */
-static unsigned char *freeptr;
+bool BACKGROUND_SWEEP = false;
+
+#define MARK_STEP_FRACTION 16
+
+
+/*!
+ * Maps a new region of at least `size` bytes onto the end of the region list.
+ * Returns false if that would exceed MAX_MEMORY_SIZE or the system refuses.
+ */
+static bool add_region(Interp *interp, size_t size) {
+    size_t page = HUGE_PAGES && size >= HUGE_PAGE_SIZE ?
+                  HUGE_PAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE);
+    size = (size + page - 1) / page * page;
+
+    if (MAX_MEMORY_SIZE != 0 && interp->heap_size + size > MAX_MEMORY_SIZE) {
+        if (interp->heap_size >= MAX_MEMORY_SIZE) {
+            return false;
+        }
+        size = MAX_MEMORY_SIZE - interp->heap_size;
+    }
+
+    if (interp->num_regions == interp->max_regions) {
+        interp->max_regions = interp->max_regions == 0 ?
+                              INITIAL_SIZE : interp->max_regions * 2;
+        struct Region *grown = realloc(interp->regions, sizeof(struct Region) *
+                                                        interp->max_regions);
+        if (grown == NULL) {
+            return false;
+        }
+        interp->regions = grown;
+    }
+
+    unsigned char *start = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (start == MAP_FAILED) {
+        return false;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (HUGE_PAGES && size >= HUGE_PAGE_SIZE) {
+        /* Only advice: if THP is disabled we simply keep small pages. */
+        madvise(start, size, MADV_HUGEPAGE);
+    }
+#endif
+
+    interp->regions[interp->num_regions].start = start;
+    interp->regions[interp->num_regions].end = start + size;
+    interp->regions[interp->num_regions].freeptr = start;
+    interp->regions[interp->num_regions].holes = NULL;
+    interp->num_regions++;
+    interp->heap_size += size;
+    return true;
+}
+
+
+/*! Unmaps every region, leaving the nursery. */
+static void unmap_regions(Interp *interp) {
+    for (int i = 0; i < interp->num_regions; i++) {
+        struct Region *region = &interp->regions[i];
+        munmap(region->start, region->end - region->start);
+    }
+
+    free(interp->regions);
+    interp->regions = NULL;
+    interp->num_regions = interp->max_regions = 0;
+    interp->heap_size = 0;
+    interp->hole_bytes = 0;
+}
+
+
+/*! The early-collection budget after a collection that left `free_bytes`
+    free. */
+static size_t alloc_budget_for(size_t free_bytes) {
+    size_t budget = free_bytes * GC_TRIGGER_PERCENT / 100;
+
+    return budget > MIN_ALLOC_BUDGET ? budget : MIN_ALLOC_BUDGET;
+}
 
 
 /*!
  * This function initializes both the allocator state, and the memory pool.  It
- * must be called before myalloc() or myfree() will work at all.
- *
- * Note that we allocate the entire memory pool using malloc().  This is so we
- * can create different memory-pool sizes for testing.  Obviously, in a real
- * allocator, this memory pool would either be a fixed memory region, or the
- * allocator would request a memory region from the operating system (see the
- * C standard function sbrk(), for example).
- */
-void init_myalloc() {
-    /*
-     * Allocate the entire memory pool, from which our simple allocator will
-     * serve allocation requests.
-     */
-    mem = (unsigned char *) malloc(MEMORY_SIZE);
-
-    if (mem == NULL) {
+ * must be called before myalloc() will work at all.  MEMORY_SIZE and
+ * MAX_MEMORY_SIZE (0 meaning unbounded) apply as they are at the time.
+ * Returns false if the system won't provide the initial region.
+ */
+bool init_myalloc(Interp *interp) {
+    interp->heap_size = 0;
+    interp->alloc_region = 0;
+
+    if (!add_region(interp, MEMORY_SIZE)) {
         fprintf(stderr,
-                "init_myalloc: could not get %d bytes from the system\n",
-		            MEMORY_SIZE);
-        abort();
+                "init_myalloc: could not get %zu bytes from the system\n",
+                MEMORY_SIZE);
+        return false;
     }
 
-    freeptr = mem;
+    if (NURSERY_SIZE > 0) {
+        unsigned char *start = mmap(NULL, NURSERY_SIZE, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (start == MAP_FAILED) {
+            fprintf(stderr, "init_myalloc: could not get a %zu byte nursery"
+                    " from the system\n", NURSERY_SIZE);
+            close_myalloc(interp);
+            return false;
+        }
+
+        interp->nursery.start = interp->nursery.freeptr = start;
+        interp->nursery.end = start + NURSERY_SIZE;
+    }
+
+    interp->allocated_since_gc = 0;
+    interp->alloc_budget = alloc_budget_for(interp->heap_size);
+    return true;
 }
 
 
 /*!
- * Attempt to allocate a chunk of memory of "size" bytes.  Return 0 if
- * allocation fails.
+ * Replaces a fresh session's empty heap with `length` bytes of blocks saved
+ * by myalloc_save_image(), mapped copy-on-write from `fd` at `offset` (which
+ * must be page aligned), so pages are only read in as they are touched.  The
+ * blocks land at the start of a single region, where they keep their RefIds;
+ * only the references' pointers to them need fixing up.  Returns false if
+ * the heap can't be had or the file can't be mapped.
  */
-void *myalloc(int size, RefId ref) {
-    int requested = sizeof(struct PoolHeader) + size;
-    if (freeptr + requested < mem + MEMORY_SIZE) {
-        /* Write the header data to the bytes beginning at freeptr */
-        struct PoolHeader *pool_header = (struct PoolHeader *) freeptr;
-        pool_header->obj_size = requested;
-        pool_header->ref = ref;
-
-        /* The data region begins just after the header */
-        unsigned char *resultptr = freeptr + sizeof(struct PoolHeader);
-
-        /* Update the free pointer and return */
-        freeptr += requested;
-        return resultptr;
+bool myalloc_load_image(Interp *interp, int fd, off_t offset, size_t length) {
+    unmap_regions(interp);
+
+    if (!add_region(interp, length > MEMORY_SIZE ? length : MEMORY_SIZE)) {
+        return false;
+    }
+
+    struct Region *region = &interp->regions[0];
+
+    if ((size_t) (region->end - region->start) < length) {
+        return false;
+    }
+
+    if (length > 0 && mmap(region->start, length, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_FIXED, fd, offset) == MAP_FAILED) {
+        return false;
+    }
+
+    region->freeptr = region->start + length;
+    interp->alloc_region = 0;
+    interp->allocated_since_gc = 0;
+    interp->alloc_budget = alloc_budget_for(interp->heap_size - length);
+    return true;
+}
+
+
+/*! Bytes currently in use (live or not yet collected) across all regions. */
+static size_t used_bytes(Interp *interp) {
+    size_t used = 0;
+
+    for (int i = 0; i < interp->num_regions; i++) {
+        used += interp->regions[i].freeptr - interp->regions[i].start;
+    }
+
+    return used - interp->hole_bytes;
+}
+
+
+/*!
+ * Raises peak_used to the bytes now in use, the nursery's included.  Use only
+ * grows between collections, so calling this before each one frees anything
+ * catches the peak.
+ */
+void myalloc_note_peak(Interp *interp) {
+    size_t used = used_bytes(interp) +
+                  (interp->nursery.freeptr - interp->nursery.start);
+
+    if (used > interp->peak_used) {
+        interp->peak_used = used;
+    }
+}
+
+
+/*!
+ * Recomputes the early-collection budget once a collection has freed all it
+ * will.  If that left less than a quarter of the heap free, grow the heap
+ * now, rather than collecting over and over while it is nearly full.
+ */
+void myalloc_rebudget(Interp *interp) {
+    if (interp->heap_size - used_bytes(interp) < interp->heap_size / 4) {
+        add_region(interp, interp->heap_size);
+    }
+
+    interp->alloc_budget = interp->allocated_since_gc +
+                           alloc_budget_for(interp->heap_size -
+                                            used_bytes(interp));
+}
+
+
+/*! Collects garbage and starts a fresh early-collection budget. */
+static void myalloc_collect(Interp *interp) {
+    collect_garbage(interp);
+    interp->allocated_since_gc = 0;
+
+    /* A background sweep sets the budget once it knows what it freed. */
+    if (interp->sweeping) {
+        interp->alloc_budget = SIZE_MAX;
     } else {
-            fprintf(stderr, "myalloc: cannot service request of size %d with"
-                    " %lx bytes allocated\n", size, (freeptr - mem));
-            return (unsigned char *) 0;
+        myalloc_rebudget(interp);
+    }
+}
+
+
+/*! Bumps `requested` bytes out of the first region at or after alloc_region
+    with room for them, or returns NULL. */
+static struct PoolHeader *bump_alloc(Interp *interp, int requested) {
+    for (int i = interp->alloc_region; i < interp->num_regions; i++) {
+        struct Region *region = &interp->regions[i];
+
+        if (region->freeptr + requested <= region->end) {
+            struct PoolHeader *pool_header =
+                (struct PoolHeader *) region->freeptr;
+            region->freeptr += requested;
+            interp->alloc_region = i;
+            return pool_header;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*! The free block after `hole` in its region's list. */
+static unsigned char *next_hole(unsigned char *hole) {
+    unsigned char *next;
+
+    memcpy(&next, hole + sizeof(struct PoolHeader), sizeof(next));
+    return next;
+}
+
+
+static void set_next_hole(struct Region *region, unsigned char *hole,
+                          unsigned char *next) {
+    if (hole == NULL) {
+        region->holes = next;
+    } else {
+        memcpy(hole + sizeof(struct PoolHeader), &next, sizeof(next));
+    }
+}
+
+
+/*! Writes the header of a free block of `size` bytes at `at`. */
+static void make_free(unsigned char *at, int size) {
+    struct PoolHeader *header = (struct PoolHeader *) at;
+
+    header->obj_size = size;
+    header->color = 0;
+    header->ref = FREE_BLOCK;
+}
+
+
+/*!
+ * Carves `requested` bytes out of the first of a region's holes, among the
+ * first few, with room for them.  What's left of the hole stays free, and
+ * stays a hole if it is big enough.  Returns NULL if none of them has room.
+ */
+static struct PoolHeader *hole_alloc(Interp *interp, struct Region *region,
+                                     int requested) {
+    unsigned char *prev = NULL, *hole = region->holes;
+
+    for (int n = 0; hole != NULL && n < HOLE_SEARCH; n++) {
+        int rest = ((struct PoolHeader *) hole)->obj_size - requested;
+        unsigned char *next = next_hole(hole);
+
+        /* A remainder needs room for a header of its own. */
+        if (rest == 0 || rest >= (int) sizeof(struct PoolHeader)) {
+            if (rest >= MIN_HOLE) {
+                make_free(hole + requested, rest);
+                set_next_hole(region, hole + requested, next);
+                next = hole + requested;
+            } else if (rest > 0) {
+                make_free(hole + requested, rest);
+            }
+
+            set_next_hole(region, prev, next);
+            interp->hole_bytes -= requested;
+            return (struct PoolHeader *) hole;
+        }
+
+        if (rest < 0 && rest + requested < SMALL_HOLE) {
+            set_next_hole(region, prev, next);
+        } else {
+            prev = hole;
+        }
+        hole = next;
     }
+
+    return NULL;
 }
 
-void memdump() {
-    unsigned char *curr = mem;
+
+/*!
+ * Allocates `requested` bytes in the regions for BACKGROUND_SWEEP, from the
+ * holes or the free end of the first region at or after alloc_region with
+ * room for them, skipping any the sweeper has yet to reach.  Returns NULL if
+ * none has room.
+ */
+static struct PoolHeader *swept_alloc(Interp *interp, int requested) {
+    bool skipped = false;
+
+    if (interp->sweeping) {
+        bgsweep_poll(interp, false);
+    }
+
+    for (int i = interp->alloc_region; i < interp->num_regions; i++) {
+        struct Region *region = &interp->regions[i];
+        struct PoolHeader *pool_header;
+
+        if (i >= interp->unswept_begin && i < interp->unswept_end) {
+            skipped = true;
+            continue;
+        }
+
+        pool_header = hole_alloc(interp, region, requested);
+        if (pool_header == NULL && region->freeptr + requested <= region->end) {
+            pool_header = (struct PoolHeader *) region->freeptr;
+            region->freeptr += requested;
+        }
+
+        if (pool_header != NULL) {
+            /* Come back for the skipped regions once they are swept. */
+            if (!skipped) {
+                interp->alloc_region = i;
+            }
+            return pool_header;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*!
+ * Allocates `requested` bytes in the regions without collecting, or returns
+ * NULL.  During a background sweep, if the swept regions have no room, waits
+ * for the sweeper to free more before giving up.
+ */
+static struct PoolHeader *region_alloc(Interp *interp, int requested) {
+    if (!BACKGROUND_SWEEP) {
+        return bump_alloc(interp, requested);
+    }
+
+    for (;;) {
+        struct PoolHeader *pool_header = swept_alloc(interp, requested);
+
+        if (pool_header != NULL || !bgsweep_poll(interp, true)) {
+            return pool_header;
+        }
+    }
+}
+
+
+/*!
+ * Called when the early-collection budget is spent: collects, or starts an
+ * incremental collection, or takes its next step, finishing it if marking is
+ * done.  An unfinished one gets another slice of the heap to allocate before
+ * the next step.
+ */
+static void myalloc_budget_spent(Interp *interp) {
+    if (GC_PAUSE_BUDGET_US <= 0) {
+        myalloc_collect(interp);
+        return;
+    }
+
+    if (!interp->marking) {
+        gc_start_marking(interp);
+    } else if (gc_mark_step(interp)) {
+        myalloc_collect(interp);
+        return;
+    }
+
+    interp->alloc_budget = interp->allocated_since_gc +
+                           interp->heap_size / MARK_STEP_FRACTION;
+}
+
+
+/*! Takes on whatever a background sweep has finished, then takes a step of
+    the incremental collection under way, if any, finishing it if marking is
+    done. */
+void myalloc_collect_step(Interp *interp) {
+    if (interp->sweeping) {
+        bgsweep_poll(interp, false);
+    }
+
+    if (interp->marking && gc_mark_step(interp)) {
+        myalloc_collect(interp);
+    }
+}
+
+
+/*!
+ * Runs a minor collection.  Promotion only ever grows the heap, never
+ * collecting it, so follow with a full collection if it had to grow, or
+ * handle the early-collection budget if promotion spent it.
+ */
+static void myalloc_collect_young(Interp *interp) {
+    int num_regions = interp->num_regions;
+
+    collect_young(interp);
+
+    if (interp->num_regions > num_regions) {
+        myalloc_collect(interp);
+    } else if (GC_TRIGGER_PERCENT > 0 &&
+               interp->allocated_since_gc > interp->alloc_budget) {
+        myalloc_budget_spent(interp);
+    }
+}
+
+
+/*!
+ * Allocates a block of `size` bytes in the regions.  If the heap is exhausted
+ * (or the early-collection budget is spent), collect garbage and retry, then
+ * grow the heap by another region; raises an error only if live data really
+ * fills MAX_MEMORY_SIZE.
+ */
+static struct PoolHeader *tenured_alloc(Interp *interp, int size) {
+    int requested = sizeof(struct PoolHeader) + size;
+
+    /* A request bigger than a whole budget only collects early if something
+     * has been allocated since the last collection. */
+    if (GC_TRIGGER_PERCENT > 0 && interp->allocated_since_gc > 0 &&
+        interp->allocated_since_gc + requested > interp->alloc_budget) {
+        myalloc_budget_spent(interp);
+    }
+
+    struct PoolHeader *pool_header = region_alloc(interp, requested);
+
+    if (pool_header == NULL) {
+        myalloc_collect(interp);
+        pool_header = region_alloc(interp, requested);
+    }
+
+    if (pool_header == NULL) {
+        /* Grow geometrically, but always by enough for this request. */
+        size_t growth = interp->heap_size > (size_t) requested ?
+                        interp->heap_size : (size_t) requested;
+        if (add_region(interp, growth) || add_region(interp, requested)) {
+            pool_header = region_alloc(interp, requested);
+        }
+    }
+
+    if (pool_header == NULL) {
+        error(interp, -1, "Out of memory: cannot service request of size %d"
+              " with %zu live bytes in a %zu byte heap.", size,
+              used_bytes(interp), interp->heap_size);
+    }
+
+    interp->allocated_since_gc += requested;
+    return pool_header;
+}
+
+
+/*! Bumps `requested` bytes out of the nursery, or returns NULL. */
+static struct PoolHeader *nursery_alloc(Interp *interp, int requested) {
+    struct Region *nursery = &interp->nursery;
+
+    if (nursery->freeptr + requested > nursery->end) {
+        return NULL;
+    }
+
+    struct PoolHeader *pool_header = (struct PoolHeader *) nursery->freeptr;
+    nursery->freeptr += requested;
+    return pool_header;
+}
+
+
+/*!
+ * Attempt to allocate a chunk of memory of "size" bytes for `ref`.  A young
+ * ref's block goes in the nursery, unless it is large, running a minor
+ * collection first if the nursery is full; an old ref's goes in the regions.
+ */
+void *myalloc(Interp *interp, int size, RefId ref) {
+    int requested = sizeof(struct PoolHeader) + size;
+    struct PoolHeader *pool_header = NULL;
+    size_t nursery_size = interp->nursery.end - interp->nursery.start;
+
+    if (!deref(interp, ref)->old &&
+        (size_t) requested <= nursery_size / NURSERY_LARGE_FRACTION) {
+        pool_header = nursery_alloc(interp, requested);
+
+        if (pool_header == NULL) {
+            /* `ref` is rooted, so this promotes it, and its block is then
+             * allocated in the regions like any old ref's. */
+            myalloc_collect_young(interp);
+        }
+    }
+
+    if (pool_header == NULL) {
+        pool_header = tenured_alloc(interp, size);
+    }
+
+    /* Write the header data to the bytes beginning at the block */
+    pool_header->obj_size = requested;
+    pool_header->color = interp->block_color;
+    pool_header->ref = ref;
+
+    /* The data region begins just after the header */
+    return (unsigned char *) pool_header + sizeof(struct PoolHeader);
+}
+
+
+/*!
+ * Sweep and compact phase of the collector.  Blocks whose owning reference was
+ * not marked (or no longer points at the block) are dropped; every live block
+ * is slid down towards the front of the heap in region order, its owner's
+ * pointer is fixed up through the header's RefId, and each region's freeptr is
+ * reset to the end of its live data.  Only the final destination region is
+ * left partially filled; every region after it is empty.  Returns the number
+ * of bytes released, headers included.
+ */
+size_t myalloc_sweep(Interp *interp) {
+    struct Region *regions = interp->regions;
+    size_t used_before;
+    int dest_region = 0;
+    unsigned char *dest = regions[0].start;
+
+    myalloc_note_peak(interp);
+    used_before = used_bytes(interp);
+    for (int i = 0; i < interp->num_regions; i++) {
+        unsigned char *curr = regions[i].start;
+
+        while (curr < regions[i].freeptr) {
+            struct PoolHeader *header = (struct PoolHeader *) curr;
+            int obj_size = header->obj_size;
+            RefId ref = header->ref;
+            unsigned char *payload = curr + sizeof(struct PoolHeader);
+
+            if (ref != FREE_BLOCK && deref(interp, ref)->marked &&
+                deref_payload(interp, ref) == payload) {
+                /* The destination is never past the block itself, so this
+                 * terminates at region i at the latest. */
+                while (dest + obj_size > regions[dest_region].end) {
+                    regions[dest_region].freeptr = dest;
+                    dest = regions[++dest_region].start;
+                }
+
+                if (dest != curr) {
+                    /* Blocks only ever move down, so memmove handles
+                     * overlap. */
+                    memmove(dest, curr, obj_size);
+                    relocate_payload(interp, ref,
+                                     dest + sizeof(struct PoolHeader));
+                }
+
+                dest += obj_size;
+            }
+
+            curr += obj_size;
+        }
+    }
+
+    regions[dest_region].freeptr = dest;
+    for (int i = dest_region + 1; i < interp->num_regions; i++) {
+        regions[i].freeptr = regions[i].start;
+    }
+    for (int i = 0; i < interp->num_regions; i++) {
+        regions[i].holes = NULL;
+    }
+    interp->alloc_region = dest_region;
+    interp->hole_bytes = 0;
+
+    return used_before - used_bytes(interp);
+}
+
+/*! Colors the block of a ref the collector has just marked as live.  Only
+    a background sweep looks at the color. */
+void myalloc_mark_block(Interp *interp, RefId ref) {
+    unsigned char *payload = deref_payload(interp, ref);
+
+    if (payload != NULL) {
+        ((struct PoolHeader *) (payload - sizeof(struct PoolHeader)))->color =
+            interp->block_color;
+    }
+}
+
+/*! Makes [start, end) free blocks, linking those big enough to reuse onto
+    the region's holes after `last`.  Returns the last hole linked. */
+static unsigned char *free_run(struct Region *region, unsigned char *last,
+                               unsigned char *start, unsigned char *end) {
+    while (start < end) {
+        size_t left = end - start;
+        size_t size = left < MAX_FREE_RUN ? left : MAX_FREE_RUN;
+
+        /* Leave whatever follows room for a header. */
+        if (left > size && left - size < sizeof(struct PoolHeader)) {
+            size -= sizeof(struct PoolHeader);
+        }
+
+        make_free(start, size);
+        if ((int) size >= MIN_HOLE) {
+            set_next_hole(region, start, NULL);
+            set_next_hole(region, last, start);
+            last = start;
+        }
+        start += size;
+    }
+
+    return last;
+}
+
+/*!
+ * Sweeps a region in place, for a background sweep: every block whose color
+ * isn't `color`, not having been reached by the last mark, is freed.  Runs
+ * of free blocks are merged, those big enough to reuse become the region's
+ * holes, and a run at the very end just moves freeptr back.  *free_bytes
+ * receives the bytes left free below freeptr; returns the bytes newly freed.
+ * Only the headers of live blocks are read, and only dead blocks written,
+ * so this can run while the mutator goes on using the live ones.
+ */
+size_t myalloc_sweep_region(struct Region *region, bool color,
+                            size_t *free_bytes) {
+    unsigned char *curr = region->start, *run = NULL, *last = NULL;
+    size_t freed = 0;
+
+    region->holes = NULL;
+    *free_bytes = 0;
+
+    while (curr < region->freeptr) {
+        struct PoolHeader *header = (struct PoolHeader *) curr;
+        unsigned char *next = curr + header->obj_size;
+
+        if (header->ref == FREE_BLOCK || header->color != color) {
+            if (header->ref != FREE_BLOCK) {
+                freed += header->obj_size;
+            }
+            if (run == NULL) {
+                run = curr;
+            }
+        } else if (run != NULL) {
+            last = free_run(region, last, run, curr);
+            *free_bytes += curr - run;
+            run = NULL;
+        }
+
+        curr = next;
+    }
+
+    if (run != NULL) {
+        region->freeptr = run;
+    }
+
+    return freed;
+}
+
+/*!
+ * Evacuation phase of a collection.  Every block in the nursery whose owner
+ * was marked (and still points at it) is copied to the end of the live data
+ * in the regions, growing the heap if there's no room, and the nursery is
+ * emptied.  Returns the number of bytes released, headers included.
+ */
+size_t myalloc_evacuate(Interp *interp) {
+    struct Region *nursery = &interp->nursery;
+    size_t used = nursery->freeptr - nursery->start, promoted = 0;
+    unsigned char *curr = nursery->start;
+
+    myalloc_note_peak(interp);
+    while (curr < nursery->freeptr) {
+        struct PoolHeader *header = (struct PoolHeader *) curr;
+        int obj_size = header->obj_size;
+        RefId ref = header->ref;
+
+        if (deref(interp, ref)->marked &&
+            deref_payload(interp, ref) == curr + sizeof(struct PoolHeader)) {
+            struct PoolHeader *dest = region_alloc(interp, obj_size);
+
+            if (dest == NULL) {
+                size_t growth = interp->heap_size > (size_t) obj_size ?
+                                interp->heap_size : (size_t) obj_size;
+                if (add_region(interp, growth) ||
+                    add_region(interp, obj_size)) {
+                    dest = region_alloc(interp, obj_size);
+                }
+            }
+
+            /* Whatever was copied before this stays consistent: its owner
+             * points at the copy, and the nursery isn't emptied. */
+            if (dest == NULL) {
+                error(interp, -1, "Out of memory: cannot promote %d bytes"
+                      " with %zu live bytes in a %zu byte heap.", obj_size,
+                      used_bytes(interp), interp->heap_size);
+            }
+
+            memcpy(dest, curr, obj_size);
+            dest->color = interp->block_color;
+            relocate_payload(interp, ref,
+                             (unsigned char *) dest +
+                             sizeof(struct PoolHeader));
+            promoted += obj_size;
+        }
+
+        curr += obj_size;
+    }
+
+    nursery->freeptr = nursery->start;
+    interp->allocated_since_gc += promoted;
+    return used - promoted;
+}
+
+/*!
+ * Writes every live block, headers included, back to back to `file`, for a
+ * snapshot; offsets[ref] receives where the payload of each reference's block
+ * landed, relative to the first byte written.  *length receives the total.
+ * Only the regions are saved, so this must follow a full collection, which
+ * leaves the nursery empty.  Returns false on a write error.
+ */
+bool myalloc_save_image(Interp *interp, FILE *file, int64_t *offsets,
+                        size_t *length) {
+    size_t written = 0;
+
+    bgsweep_finish(interp, NULL);
+    for (int i = 0; i < interp->num_regions; i++) {
+        unsigned char *curr = interp->regions[i].start;
+
+        while (curr < interp->regions[i].freeptr) {
+            struct PoolHeader *header = (struct PoolHeader *) curr;
+            unsigned char *payload = curr + sizeof(struct PoolHeader);
+            RefId ref = header->ref;
+
+            if (ref != FREE_BLOCK && deref(interp, ref)->occupied &&
+                deref_payload(interp, ref) == payload) {
+                if (fwrite(curr, 1, header->obj_size, file) !=
+                        (size_t) header->obj_size) {
+                    return false;
+                }
+
+                offsets[ref] = written + sizeof(struct PoolHeader);
+                written += header->obj_size;
+            }
+
+            curr += header->obj_size;
+        }
+    }
+
+    *length = written;
+    return true;
+}
+
+static void dump_region(Interp *interp, struct Region *region) {
+    unsigned char *curr = region->start;
     unsigned char *curr_data;
     struct PoolHeader *curr_header;
 
-    while (curr < freeptr) {
+    while (curr < region->freeptr) {
         curr_header = (struct PoolHeader *) curr;
         curr_data = curr + sizeof(struct PoolHeader);
-        fprintf(stdout, "size %lu; refId %d; data: ",
+        if (curr_header->ref == FREE_BLOCK) {
+            curr += curr_header->obj_size;
+            continue;
+        }
+
+        fprintf(interp->out, "size %lu; refId %d; data: ",
                 curr_header->obj_size - sizeof(struct PoolHeader),
                 curr_header->ref);
-        for (int i = 0; i < curr_header->obj_size - sizeof(struct PoolHeader); i++) {
-            fprintf(stdout, "%c", curr_data[i]);
+        for (size_t j = 0;
+             j < curr_header->obj_size - sizeof(struct PoolHeader); j++) {
+            fprintf(interp->out, "%c", curr_data[j]);
         }
-        fprintf(stdout, "\n");
+        fprintf(interp->out, "\n");
 
         curr += curr_header->obj_size;
     }
 }
 
+void memdump(Interp *interp) {
+    bgsweep_finish(interp, NULL);
+    for (int i = 0; i < interp->num_regions; i++) {
+        dump_region(interp, &interp->regions[i]);
+    }
+
+    if (interp->nursery.start != NULL) {
+        dump_region(interp, &interp->nursery);
+    }
+}
+
 
 /*!
  * Clean up the allocator state.
- * All this really has to do is free the user memory pool. This function mostly
+ * All this really has to do is unmap the heap regions. This function mostly
  * ensures that the test program doesn't leak memory, so it's easy to check
  * if the allocator does.
  */
-void close_myalloc() {
-    free(mem);
+void close_myalloc(Interp *interp) {
+    unmap_regions(interp);
+
+    if (interp->nursery.start != NULL) {
+        munmap(interp->nursery.start,
+               interp->nursery.end - interp->nursery.start);
+        interp->nursery.start = interp->nursery.end = NULL;
+        interp->nursery.freeptr = NULL;
+    }
 }
@@ -11,25 +11,98 @@
 #ifndef MYALLOC_H
 #define MYALLOC_H
 
+#include <sys/types.h>
+
 #include "eval.h"
 
-/*! Specifies the size of the memory pool the allocator has to work with. */
-extern int MEMORY_SIZE;
+/*! Specifies the initial size of the heap the allocator has to work with. */
+extern size_t MEMORY_SIZE;
+
+/*! Upper bound the heap may grow to, across all regions; 0 is unbounded. */
+extern size_t MAX_MEMORY_SIZE;
+
+/*! Ask for transparent huge pages on regions of 2 MB and up. */
+extern bool HUGE_PAGES;
+
+/*! Percentage of post-collection free space to allocate before collecting. */
+extern int GC_TRIGGER_PERCENT;
+
+/*! Size of the young generation's nursery; 0 means a single generation. */
+extern size_t NURSERY_SIZE;
+
+/*! Microseconds each incremental marking step may take; 0 means full
+    collections stop the world. */
+extern int GC_PAUSE_BUDGET_US;
+
+/*! Threads that mark a full collection's final pause; 1 marks serially. */
+extern int GC_MARK_THREADS;
+
+/*! Sweep full collections on a background thread, rather than compacting
+    the heap in the pause. */
+extern bool BACKGROUND_SWEEP;
+
+/*! One mmap()ed bump region of a session's heap. */
+struct Region {
+    unsigned char *start, *end;
+    /*! Where free memory in this region starts. */
+    unsigned char *freeptr;
+    /*! After a background sweep, the free blocks below freeptr that are big
+        enough to reuse, linked in address order; NULL if none. */
+    unsigned char *holes;
+};
 
 
 /* Initializes allocator state, and memory pool state too. */
-void init_myalloc();
+bool init_myalloc(Interp *interp);
 
 
 /* Attempt to allocate a chunk of memory of "size" bytes. */
-void *myalloc(int size, RefId ref);
+void *myalloc(Interp *interp, int size, RefId ref);
+
+
+/* Release unmarked blocks and slide the live ones down to the heap start. */
+size_t myalloc_sweep(Interp *interp);
+
+
+/* Copy the marked blocks out of the nursery, then empty it. */
+size_t myalloc_evacuate(Interp *interp);
+
+
+/* Note that a just-marked reference's block is live, for BACKGROUND_SWEEP. */
+void myalloc_mark_block(Interp *interp, RefId ref);
+
+
+/* Free the blocks of one region not of `color`, in place. */
+size_t myalloc_sweep_region(struct Region *region, bool color,
+                            size_t *free_bytes);
+
+
+/* Record the bytes in use, if the most yet, before a collection frees any. */
+void myalloc_note_peak(Interp *interp);
+
+
+/* Set the early-collection budget once a collection has done its freeing. */
+void myalloc_rebudget(Interp *interp);
+
+
+/* Advance the incremental collection under way, between statements. */
+void myalloc_collect_step(Interp *interp);
+
+
+/* Write the live blocks out for a snapshot. */
+bool myalloc_save_image(Interp *interp, FILE *file, int64_t *offsets,
+                        size_t *length);
+
+
+/* Map a snapshot's blocks in as the heap of a fresh session. */
+bool myalloc_load_image(Interp *interp, int fd, off_t offset, size_t length);
 
 
 /* Print all the information in the pool. */
-void memdump();
+void memdump(Interp *interp);
 
 
 /* Clean up the allocator and memory pool state. */
-void close_myalloc();
+void close_myalloc(Interp *interp);
 
 #endif /* MYALLOC_H */
@@ -0,0 +1,459 @@
+/*! \file
+ * Parallel marking for full collections.  The collecting thread and
+ * GC_MARK_THREADS - 1 helper threads, started by the session's first parallel
+ * mark and kept until it ends, share out the grey refs and trace them
+ * together.
+ *
+ * Each worker traces from a private mark stack.  While it has plenty of work
+ * and another worker is idle, it moves the older half of its stack into its
+ * shared queue, from which idle workers steal half at a time.  Which worker
+ * traces a ref is settled by an atomic bit per RefId in a side bitmap, so each
+ * is traced once; only the winner then reads and sets the ref's `marked` flag,
+ * which the rest of the collector goes by.  A ref that was marked before the
+ * parallel phase began (a root, or one blackened by an incremental step) is
+ * left alone, since whoever marked it traces it.
+ *
+ * Marking is over once every worker is idle: work is only ever shared by a
+ * busy worker, and a worker only goes idle once its own queue is empty.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "global.h"
+#include "eval.h"
+#include "interp.h"
+#include "dict.h"
+#include "list.h"
+#include "myalloc.h"
+#include "parmark.h"
+
+/*! A worker only shares work while its stack holds at least this many. */
+#define SHARE_MIN 64
+
+typedef struct MarkPool MarkPool;
+
+typedef struct MarkWorker {
+    MarkPool *pool;
+    /*! Only ever touched by the worker itself. */
+    RefId *stack;
+    int top, max;
+    /*! Work offered to the other workers, under `lock`.  `available` mirrors
+        num_shared, so thieves can look without taking the lock. */
+    pthread_mutex_t lock;
+    RefId *shared;
+    int num_shared, max_shared;
+    atomic_int available;
+} MarkWorker;
+
+struct MarkPool {
+    Interp *interp;
+    /*! The workers; workers[0] is the collecting thread. */
+    MarkWorker *workers;
+    int num_workers;
+    pthread_t *helpers;
+    int num_helpers;
+
+    /*! Helpers start a round when `round` changes, and count themselves
+        `finished` at its end; all under `lock`. */
+    pthread_mutex_t lock;
+    pthread_cond_t wake, done;
+    unsigned long round;
+    int finished;
+    bool shutdown;
+
+    /*! Workers with nothing to do; marking is over when all of them are. */
+    atomic_int idle;
+    /*! Set when a worker couldn't grow its stack, and so lost a ref. */
+    atomic_bool failed;
+
+    /*! One bit per RefId, set by the worker that claims it. */
+    _Atomic uint64_t *bits;
+    size_t num_words;
+};
+
+/*! Makes room for `extra` more RefIds after the first `count` of an array. */
+static bool reserve(RefId **array, int count, int *max, int extra) {
+    if (count + extra <= *max) {
+        return true;
+    }
+
+    int new_max = *max == 0 ? INITIAL_SIZE : *max;
+    while (new_max < count + extra) {
+        new_max *= 2;
+    }
+
+    RefId *grown = realloc(*array, sizeof(RefId) * new_max);
+    if (grown == NULL) {
+        return false;
+    }
+
+    *array = grown;
+    *max = new_max;
+    return true;
+}
+
+/*! Claims a value for the worker to trace, unless it's a float or someone
+    has marked it already. */
+static void mark_child(MarkWorker *worker, RefId ref) {
+    MarkPool *pool = worker->pool;
+
+    if (ref < 0 || is_float_ref(ref)) {
+        return;
+    }
+
+    _Atomic uint64_t *word = &pool->bits[ref / 64];
+    uint64_t bit = (uint64_t) 1 << (ref % 64);
+
+    /* Most refs are reached more than once, and a load is cheaper than a
+     * read-modify-write. */
+    if ((atomic_load_explicit(word, memory_order_relaxed) & bit) ||
+        (atomic_fetch_or_explicit(word, bit, memory_order_relaxed) & bit)) {
+        return;
+    }
+
+    Reference *r = deref(pool->interp, ref);
+
+    if (r->marked) {
+        return;
+    }
+
+    r->marked = true;
+    if (BACKGROUND_SWEEP) {
+        myalloc_mark_block(pool->interp, ref);
+    }
+    if (!reserve(&worker->stack, worker->top, &worker->max, 1)) {
+        atomic_store(&pool->failed, true);
+        return;
+    }
+    worker->stack[worker->top++] = ref;
+}
+
+/*! Claims what a list or dict holds. */
+static void trace(MarkWorker *worker, RefId ref) {
+    Reference *r = deref(worker->pool->interp, ref);
+
+    if (r->type == VAL_LIST) {
+        ListArray *array = r->list;
+
+        for (int i = 0; i < array->length; i++) {
+            mark_child(worker, array->items[i]);
+        }
+    } else if (r->type == VAL_DICT) {
+        DictEntry *entries = dict_entries(r->dict);
+
+        for (int i = 0; i < r->dict->count; i++) {
+            mark_child(worker, entries[i].key);
+            mark_child(worker, entries[i].value);
+        }
+    }
+}
+
+/*! Moves the older half of the worker's stack to its shared queue. */
+static void share(MarkWorker *worker) {
+    int half = worker->top / 2;
+
+    pthread_mutex_lock(&worker->lock);
+    if (reserve(&worker->shared, worker->num_shared, &worker->max_shared,
+                half)) {
+        memcpy(worker->shared + worker->num_shared, worker->stack,
+               sizeof(RefId) * half);
+        worker->num_shared += half;
+        atomic_store(&worker->available, worker->num_shared);
+
+        memmove(worker->stack, worker->stack + half,
+                sizeof(RefId) * (worker->top - half));
+        worker->top -= half;
+    }
+    pthread_mutex_unlock(&worker->lock);
+}
+
+/*! Moves work from `victim`'s shared queue onto the worker's stack: all of
+    it from the worker's own queue, half from another's.  Returns false if
+    there was none to be had. */
+static bool take(MarkWorker *worker, MarkWorker *victim) {
+    bool took = false;
+
+    if (atomic_load(&victim->available) == 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&victim->lock);
+    int n = victim == worker ? victim->num_shared
+                             : (victim->num_shared + 1) / 2;
+
+    if (n > 0 && reserve(&worker->stack, worker->top, &worker->max, n)) {
+        victim->num_shared -= n;
+        memcpy(worker->stack + worker->top, victim->shared + victim->num_shared,
+               sizeof(RefId) * n);
+        worker->top += n;
+        atomic_store(&victim->available, victim->num_shared);
+        took = true;
+    } else if (n > 0) {
+        atomic_store(&worker->pool->failed, true);
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    return took;
+}
+
+/*! Takes work from the worker's own queue, or steals some. */
+static bool find_work(MarkWorker *worker) {
+    MarkPool *pool = worker->pool;
+    int self = worker - pool->workers;
+
+    for (int i = 0; i < pool->num_workers; i++) {
+        if (take(worker, &pool->workers[(self + i) % pool->num_workers])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool work_available(MarkPool *pool) {
+    for (int i = 0; i < pool->num_workers; i++) {
+        if (atomic_load(&pool->workers[i].available) > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*! Traces until every worker is out of work.  After a failure, workers just
+    drop what they have, so that marking ends. */
+static void run_worker(MarkWorker *worker) {
+    MarkPool *pool = worker->pool;
+
+    for (;;) {
+        while (worker->top > 0 &&
+               !atomic_load_explicit(&pool->failed, memory_order_relaxed)) {
+            trace(worker, worker->stack[--worker->top]);
+
+            if (worker->top >= SHARE_MIN &&
+                atomic_load_explicit(&worker->available,
+                                     memory_order_relaxed) == 0 &&
+                atomic_load_explicit(&pool->idle, memory_order_relaxed) > 0) {
+                share(worker);
+            }
+        }
+
+        if (atomic_load(&pool->failed)) {
+            worker->top = 0;
+            pthread_mutex_lock(&worker->lock);
+            worker->num_shared = 0;
+            atomic_store(&worker->available, 0);
+            pthread_mutex_unlock(&worker->lock);
+        } else if (find_work(worker)) {
+            continue;
+        }
+
+        atomic_fetch_add(&pool->idle, 1);
+        for (;;) {
+            if (atomic_load(&pool->idle) == pool->num_workers) {
+                return;
+            }
+
+            if (!atomic_load(&pool->failed) && work_available(pool)) {
+                atomic_fetch_sub(&pool->idle, 1);
+                if (find_work(worker)) {
+                    break;
+                }
+                atomic_fetch_add(&pool->idle, 1);
+            }
+
+            sched_yield();
+        }
+    }
+}
+
+/*! A helper thread: runs a worker for every round until shut down. */
+static void *helper_main(void *arg) {
+    MarkWorker *worker = arg;
+    MarkPool *pool = worker->pool;
+    unsigned long round = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->round == round && !pool->shutdown) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+
+        if (pool->shutdown) {
+            break;
+        }
+
+        round = pool->round;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_worker(worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->finished == pool->num_helpers) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/*! Stops and frees the session's marker threads, if it has any. */
+void parallel_mark_destroy(Interp *interp) {
+    MarkPool *pool = interp->mark_pool;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_helpers; i++) {
+        pthread_join(pool->helpers[i], NULL);
+    }
+
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_mutex_destroy(&pool->workers[i].lock);
+        free(pool->workers[i].stack);
+        free(pool->workers[i].shared);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool->helpers);
+    free(pool->bits);
+    free(pool);
+    interp->mark_pool = NULL;
+}
+
+/*! Returns the session's pool of GC_MARK_THREADS workers, starting it if
+    need be, or NULL if the threads can't be had. */
+static MarkPool *get_pool(Interp *interp) {
+    MarkPool *pool = interp->mark_pool;
+
+    if (pool != NULL && pool->num_workers == GC_MARK_THREADS) {
+        return pool;
+    }
+
+    parallel_mark_destroy(interp);
+
+    pool = calloc(1, sizeof(MarkPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    interp->mark_pool = pool;
+    pool->interp = interp;
+    pool->num_workers = GC_MARK_THREADS;
+    pool->workers = calloc(pool->num_workers, sizeof(MarkWorker));
+    pool->helpers = malloc(sizeof(pthread_t) * (pool->num_workers - 1));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    if (pool->workers == NULL || pool->helpers == NULL) {
+        pool->num_workers = 0;
+        parallel_mark_destroy(interp);
+        return NULL;
+    }
+
+    for (int i = 0; i < pool->num_workers; i++) {
+        pool->workers[i].pool = pool;
+        pthread_mutex_init(&pool->workers[i].lock, NULL);
+        atomic_init(&pool->workers[i].available, 0);
+    }
+
+    while (pool->num_helpers < pool->num_workers - 1) {
+        if (pthread_create(&pool->helpers[pool->num_helpers], NULL,
+                           helper_main,
+                           &pool->workers[pool->num_helpers + 1]) != 0) {
+            parallel_mark_destroy(interp);
+            return NULL;
+        }
+        pool->num_helpers++;
+    }
+
+    return pool;
+}
+
+/*!
+ * Traces the grey refs on the session's mark stack, and everything they
+ * reach, on GC_MARK_THREADS threads, leaving the stack empty.  Returns false,
+ * having done nothing, if the threads or memory can't be had, in which case
+ * the caller should mark serially.  Raises an error if a worker runs out of
+ * memory part way, once every mark is cleared, since some marked ref may not
+ * have been traced.
+ */
+bool parallel_mark(Interp *interp) {
+    MarkPool *pool = get_pool(interp);
+
+    if (pool == NULL) {
+        return false;
+    }
+
+    size_t num_words = ((size_t) interp->num_refs + 63) / 64;
+
+    if (num_words > pool->num_words) {
+        _Atomic uint64_t *bits = realloc(pool->bits,
+                                         sizeof(*bits) * num_words);
+        if (bits == NULL) {
+            return false;
+        }
+        pool->bits = bits;
+        pool->num_words = num_words;
+    }
+
+    for (size_t i = 0; i < num_words; i++) {
+        atomic_init(&pool->bits[i], 0);
+    }
+
+    for (int i = 0; i < interp->mark_top; i++) {
+        MarkWorker *worker = &pool->workers[i % pool->num_workers];
+
+        if (!reserve(&worker->stack, worker->top, &worker->max, 1)) {
+            for (int w = 0; w < pool->num_workers; w++) {
+                pool->workers[w].top = 0;
+            }
+            return false;
+        }
+        worker->stack[worker->top++] = interp->mark_stack[i];
+    }
+
+    interp->mark_top = 0;
+    atomic_store(&pool->idle, 0);
+    atomic_store(&pool->failed, false);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->finished = 0;
+    pool->round++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_worker(&pool->workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->finished < pool->num_helpers) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (atomic_load(&pool->failed)) {
+        /* Back to how things are between collections, so the next one
+         * starts afresh. */
+        for (int i = 0; i < interp->num_refs; i++) {
+            interp->ref_table[i].marked = false;
+        }
+        interp->marking = false;
+        error(interp, -1, "%s", "Allocation failed!");
+    }
+
+    return true;
+}
@@ -0,0 +1,17 @@
+/*! \file
+ * Declarations for the parallel marker that full collections use when
+ * GC_MARK_THREADS is more than 1.
+ */
+
+#ifndef PARMARK_H
+#define PARMARK_H
+
+#include "eval.h"
+
+/* Trace every grey ref on the mark stack, and all they reach, in parallel. */
+bool parallel_mark(Interp *interp);
+
+/* Stop the session's marker threads, if it has any. */
+void parallel_mark_destroy(Interp *interp);
+
+#endif /* PARMARK_H */
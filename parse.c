@@ -8,239 +8,299 @@
 
 #include "global.h"
 #include "parse.h"
+#include "scan.h"
+#include "interp.h"
 
 ///////////////////// LEXING /////////////////////
 
-//TODO: do we want a max line size and a statically allocated buffer, or a
-// manually allocated buffer, and an infinite line size? hmmm...
-static char *current_string = NULL;
-static int idx;
-static char current, next;
+// Tokens are slices of Interp.lex_string, so it must outlive the statement's
+// parse; lines may be any length.
 
-const char *curr_string() {
-    return current_string;
+const char *curr_string(Interp *interp) {
+    return interp->lex_string;
 }
 
-int curr_pos() {
-    return idx - 2;
+int curr_pos(Interp *interp) {
+    return interp->lex_pos;
 }
 
-char curr_char() {
-    return current;
+/*! The text from the current character on. */
+static inline const char *lex_rest(Interp *interp) {
+    return &interp->lex_string[interp->lex_pos];
 }
 
-char next_char() {
-    return next;
+/*! Moves the current character to `p`, within the text. */
+static inline void lex_skip_to(Interp *interp, const char *p) {
+    interp->lex_pos = p - interp->lex_string;
 }
 
-void bump_char() {
-    if (next == '\0') {
-        current = '\0';
-    } else {
-        current = next;
-        next = current_string[idx++];
+char curr_char(Interp *interp) {
+    return *lex_rest(interp);
+}
+
+char next_char(Interp *interp) {
+    return *lex_rest(interp) == '\0' ? '\0' : lex_rest(interp)[1];
+}
+
+void bump_char(Interp *interp) {
+    if (*lex_rest(interp) != '\0') {
+        interp->lex_pos++;
     }
 }
 
-void init_lex(char *new_string) {
-    current_string = new_string;
-    idx = 0;
-    // We need to make sure that the char stream is now buffered.
-    // Give the current current, next some dummy values.
-    current = next = '_';
-    // Then bump twice so the first char of new_string sits on current.
-    bump_char();
-    bump_char();
+void init_lex(Interp *interp, const char *new_string) {
+    interp->lex_string = new_string;
+    interp->lex_pos = 0;
 }
 
 ///////////////////// TOKENIZING /////////////////////
 
-/*! The current token while parsing. */
-static Token curr_token;
-
-void read_string();
-void read_float();
-void read_identifier();
+void read_string(Interp *interp);
+void read_float(Interp *interp);
+void read_identifier(Interp *interp);
 
-/*!
- * Moves the "token pointer" one token ahead on the current character stream.
- */
-void bump_token() {
+/*! Scans the next token on the current character stream. */
+static void lex_token(Interp *interp) {
     // For now, eat all spaces before the token.
-    while (curr_char() == ' ' || curr_char() == '\t') {
-        bump_char();
-    }
+    lex_skip_to(interp, scan_blanks(lex_rest(interp)));
 
-    curr_token.pos = curr_pos();
+    interp->curr_token.pos = curr_pos(interp);
 
-    switch (curr_char()) {
+    switch (curr_char(interp)) {
         case '\0':
         case EOF:
-            bump_char();
-            curr_token.type = STREAM_END;
+            bump_char(interp);
+            interp->curr_token.type = STREAM_END;
 
         case '\n':
-            bump_char();
-            curr_token.type = LINE_END;
+            bump_char(interp);
+            interp->curr_token.type = LINE_END;
             break;
 
         case '(':
-            bump_char();
-            curr_token.type = LPAREN;
+            bump_char(interp);
+            interp->curr_token.type = LPAREN;
             break;
 
         case ')':
-            bump_char();
-            curr_token.type = RPAREN;
+            bump_char(interp);
+            interp->curr_token.type = RPAREN;
             break;
 
         case '[':
-            bump_char();
-            curr_token.type = LBRACKET;
+            bump_char(interp);
+            interp->curr_token.type = LBRACKET;
             break;
 
         case ']':
-            bump_char();
-            curr_token.type = RBRACKET;
+            bump_char(interp);
+            interp->curr_token.type = RBRACKET;
             break;
 
         case '{':
-            bump_char();
-            curr_token.type = LBRACE;
+            bump_char(interp);
+            interp->curr_token.type = LBRACE;
             break;
 
         case '}':
-            bump_char();
-            curr_token.type = RBRACE;
+            bump_char(interp);
+            interp->curr_token.type = RBRACE;
             break;
 
         case ':':
-            bump_char();
-            curr_token.type = COLON;
+            bump_char(interp);
+            interp->curr_token.type = COLON;
             break;
 
         case '*':
-            bump_char();
-            curr_token.type = ASTERISK;
+            bump_char(interp);
+            interp->curr_token.type = ASTERISK;
             break;
 
         case '/':
-            bump_char();
-            curr_token.type = SLASH;
+            bump_char(interp);
+            interp->curr_token.type = SLASH;
             break;
 
         case '.':
-            bump_char();
-            curr_token.type = DOT;
+            bump_char(interp);
+            interp->curr_token.type = DOT;
             break;
 
         case ',':
-            bump_char();
-            curr_token.type = COMMA;
+            bump_char(interp);
+            interp->curr_token.type = COMMA;
             break;
 
         case '+':
-            bump_char();
-            curr_token.type = PLUS;
+            bump_char(interp);
+            interp->curr_token.type = PLUS;
             break;
 
         case '-':
-            bump_char();
-            curr_token.type = MINUS;
+            bump_char(interp);
+            interp->curr_token.type = MINUS;
             break;
 
         case '=':
-            bump_char();
-            curr_token.type = EQUAL;
+            bump_char(interp);
+            interp->curr_token.type = EQUAL;
             break;
 
         case '\'':
         case '\"':
-            read_string();
+            read_string(interp);
             break;
 
         default: {
-                if (isdigit(curr_char())) {
-                    read_float();
-                } else if (isalpha(curr_char()) || curr_char() == '_') {
-                    read_identifier();
+                if (isdigit(curr_char(interp))) {
+                    read_float(interp);
+                } else if (isalpha(curr_char(interp)) ||
+                           curr_char(interp) == '_') {
+                    read_identifier(interp);
                 } else {
-                    error(curr_pos(), "Unknown token");
+                    error(interp, curr_pos(interp), "Unknown token");
                 }
             }
             break;
     }
 }
 
-void read_string() {
-    int string_idx = 0;
-    char start = curr_char();
-    bump_char();
+void read_string(Interp *interp) {
+    Token *token = &interp->curr_token;
+    char start = curr_char(interp);
+    const char *text = lex_rest(interp) + 1;
+    const char *end = scan_quote(text, start);
 
-    while (curr_char() != start) {
-        //TODO: easy to add escapes.
-        curr_token.string[string_idx++] = curr_char();
-        bump_char();
+    //TODO: easy to add escapes.
+    if (*end != start) {
+        error(interp, curr_pos(interp), "Unterminated string literal.");
     }
-    bump_char();
 
-    curr_token.string[string_idx] = '\0';
-    curr_token.type = STRING;
+    token->start = curr_pos(interp) + 1;
+    token->length = end - text;
+    token->type = STRING;
+    lex_skip_to(interp, end + 1);
 }
 
-void read_float() {
-    int string_idx = 0;
-
-    while (isdigit(curr_char())) {
-        //TODO: size limit
-        curr_token.string[string_idx++] = curr_char();
-        bump_char();
+/*! Parses the digits [.digits] at the current position.  Up to 19
+    significant digits are exact in a uint64_t, and a mantissa of at most
+    2^53 scaled by at most 10^22 is a single correctly rounded division;
+    anything longer falls back to strtod() on a copy of the slice. */
+void read_float(Interp *interp) {
+    static const double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    Token *token = &interp->curr_token;
+    uint64_t mantissa = 0;
+    int num_digits = 0, num_decimals = 0;
+
+    token->start = curr_pos(interp);
+
+    while (isdigit(curr_char(interp))) {
+        mantissa = mantissa * 10 + (curr_char(interp) - '0');
+        num_digits++;
+        bump_char(interp);
     }
 
-    if (curr_char() == '.' && isdigit(next_char())) {
-        bump_char();
-        curr_token.string[string_idx++] = '.';
+    if (curr_char(interp) == '.' && isdigit(next_char(interp))) {
+        bump_char(interp);
 
-        while (isdigit(curr_char())) {
-            //TODO: size limit
-            curr_token.string[string_idx++] = curr_char();
-            bump_char();
+        while (isdigit(curr_char(interp))) {
+            mantissa = mantissa * 10 + (curr_char(interp) - '0');
+            num_digits++;
+            num_decimals++;
+            bump_char(interp);
         }
+    }
 
-        curr_token.string[string_idx] = '\0';
-        curr_token.float_value = atof(curr_token.string);
-        curr_token.type = FLOAT;
+    token->length = curr_pos(interp) - token->start;
+    token->type = FLOAT;
+
+    if (num_digits <= 19 && mantissa <= (UINT64_C(1) << 53) &&
+            num_decimals <= 22) {
+        token->float_value = mantissa / powers_of_ten[num_decimals];
     } else {
-        curr_token.string[string_idx] = '\0';
-        curr_token.float_value = atoi(curr_token.string);
-        curr_token.type = FLOAT;
+        char *copy = strndup(&interp->lex_string[token->start],
+                             token->length);
+
+        if (copy == NULL) {
+            error(interp, -1, "%s", "Allocation failed!");
+        }
+
+        token->float_value = strtod(copy, NULL);
+        free(copy);
     }
 }
 
-void read_identifier() {
-    int string_idx = 0;
+/*! Whether the current token's text is `keyword`. */
+bool token_is(Interp *interp, const char *keyword) {
+    Token *token = &interp->curr_token;
 
-    while (isalnum(curr_char()) || curr_char() == '_') {
-        curr_token.string[string_idx++] = curr_char();
-        bump_char();
-    }
+    return (size_t) token->length == strlen(keyword) &&
+           memcmp(&interp->lex_string[token->start], keyword,
+                  token->length) == 0;
+}
 
-    curr_token.string[string_idx] = '\0';
+void read_identifier(Interp *interp) {
+    Token *token = &interp->curr_token;
 
-    if (strcmp(curr_token.string, "del") == 0) {
-        curr_token.type = DEL;
-    } else if (strcmp(curr_token.string, "gc") == 0) {
-        curr_token.type = GC;
+    token->start = curr_pos(interp);
+    lex_skip_to(interp, scan_identifier(lex_rest(interp)));
+    token->length = curr_pos(interp) - token->start;
+
+    if (token_is(interp, "del")) {
+        token->type = DEL;
+    } else if (token_is(interp, "gc")) {
+        token->type = GC;
     } else {
-        curr_token.type = IDENT;
+        token->type = IDENT;
     }
 }
 
+/*!
+ * Moves the "token pointer" one token ahead on the current character stream.
+ * While profiling, the time it takes is counted as lexing.
+ */
+void bump_token(Interp *interp) {
+    if (!interp->profile) {
+        lex_token(interp);
+        return;
+    }
+
+    double start = phase_clock();
+    lex_token(interp);
+    interp->phase_times.lex += phase_clock() - start;
+}
+
+/*! Copies the current token's text into the parse arena. */
+uint32_t token_string_dup(Interp *interp) {
+    Token *token = &interp->curr_token;
+
+    return parse_string_dup(interp, &interp->lex_string[token->start],
+                            token->length);
+}
+
+/*! Tokenizes a line without parsing it, returning how many tokens it
+    had.  Used to benchmark the lexer on its own. */
+int lex_line(Interp *interp, const char *string) {
+    int num_tokens = 0;
+    init_lex(interp, string);
+
+    do {
+        bump_token(interp);
+        num_tokens++;
+    } while (interp->curr_token.type != LINE_END);
+
+    return num_tokens;
+}
+
 /*! Bumps the token stream if the current token matches type T,
     returning whether the token matched. */
-bool try_consume(TokenType t) {
-    if (curr_token.type == t) {
-        bump_token();
+bool try_consume(Interp *interp, TokenType t) {
+    if (interp->curr_token.type == t) {
+        bump_token(interp);
         return true;
     } else {
         return false;
@@ -275,234 +335,254 @@ const char *tok_str(TokenType t) {
 }
 
 /*! Expects a token, otherwise throws an error. */
-void expect(TokenType t) {
-    if (curr_token.type != t) {
-        error(curr_token.pos, "Expected token `%s`, got `%s`.",
-              tok_str(t), tok_str(curr_token.type));
+void expect(Interp *interp, TokenType t) {
+    if (interp->curr_token.type != t) {
+        error(interp, interp->curr_token.pos, "Expected token `%s`, got `%s`.",
+              tok_str(t), tok_str(interp->curr_token.type));
     }
 }
 
 /*! Expects a token, bumping if it was found, otherwise throws an
     error. */
-void expect_consume(TokenType t) {
-    expect(t);
-    bump_token();
+void expect_consume(Interp *interp, TokenType t) {
+    expect(interp, t);
+    bump_token(interp);
 }
 
 ///////////////////// PARSING /////////////////////
 
-ParseStatement *read_statement();
+ParseStatement *read_statement(Interp *interp);
 
-ParseExpression *read_expression();
-ParseExpression *read_literal();
-ParseExpression *read_paren_expression();
-ParseExpression *read_list_literal();
-ParseExpression *read_dict_literal();
-bool is_lval(ParseExpression *);
-bool is_stmt(ParseExpression *);
+ExprId read_expression(Interp *interp, int precedence);
+ExprId read_literal(Interp *interp);
+ExprId read_paren_expression(Interp *interp);
+ExprId read_list_literal(Interp *interp);
+ExprId read_dict_literal(Interp *interp);
+bool is_lval(Interp *interp, ExprId expr);
+bool is_stmt(Interp *interp, ExprId expr);
 
 int get_precedence(TokenType);
 bool is_operator(TokenType);
 bool is_right_assoc(TokenType);
 ExpressionType expression_type(TokenType);
 
-/*! Serves as the entrypoint into the parser, taking ownership of
-    the string. */
-ParseStatement *read(char *string) {
-    init_lex(string);
-    bump_token();
-    return read_statement();
+/*! Serves as the entrypoint into the parser, reading the statement on the
+    first line of the string; further lines are left for read_end().  The
+    result is only valid until parse_reset(). */
+ParseStatement *read(Interp *interp, const char *string) {
+    init_lex(interp, string);
+    bump_token(interp);
+    return read_statement(interp);
+}
+
+/*! Where the input after the statement last read starts. */
+const char *read_end(Interp *interp) {
+    return lex_rest(interp);
 }
 
-ParseStatement *read_statement() {
-    ParseStatement *stmt;
+ParseStatement *read_statement(Interp *interp) {
+    ParseStatement *stmt = &interp->curr_stmt;
 
-    if (try_consume(LINE_END)) {
+    // The line's end isn't consumed, so that lexing stops at its newline.
+    if (interp->curr_token.type == LINE_END) {
         return NULL;
-    } else if (try_consume(GC)) {
-        expect_consume(LPAREN);
-        expect_consume(RPAREN);
+    } else if (try_consume(interp, GC)) {
+        expect_consume(interp, LPAREN);
+        expect_consume(interp, RPAREN);
 
-        stmt = parse_alloc(sizeof(ParseStatement));
         stmt->type = STMT_GC;
-        expect_consume(LINE_END);
-    } else if (try_consume(DEL)) {
-        expect(IDENT);
-        stmt = parse_alloc(sizeof(ParseStatement));
+        expect(interp, LINE_END);
+    } else if (try_consume(interp, DEL)) {
+        expect(interp, IDENT);
         stmt->type = STMT_DEL;
-        stmt->identifier = curr_token.string;
-        bump_token();
-        expect_consume(LINE_END);
+        stmt->identifier = token_string_dup(interp);
+        bump_token(interp);
+        expect(interp, LINE_END);
     } else {
         // We need to parse an ParseExpression ParseStatement.
-        ParseExpression *expr = read_expression(PRECEDENCE_LOWEST);
+        ExprId expr = read_expression(interp, PRECEDENCE_LOWEST);
 
-        stmt = parse_alloc(sizeof(ParseStatement));
         stmt->type = STMT_EXPR;
         stmt->expr = expr;
-        expect_consume(LINE_END);
+        expect(interp, LINE_END);
     }
 
     return stmt;
 }
 
-ParseExpression *read_expression(int precedence) {
-    ParseExpression *lhs = read_literal();
+/*! Adds a node with two children. */
+ExprId new_binary_expr(Interp *interp, ExpressionType type, ExprId lhs,
+                       ExprId rhs) {
+    ExprId expr = parse_new_expr(interp, type);
+    parse_expr(interp, expr)->lhs = lhs;
+    parse_expr(interp, expr)->rhs = rhs;
+    return expr;
+}
+
+ExprId read_expression(Interp *interp, int precedence) {
+    ExprId lhs = read_literal(interp);
 
-    while (is_operator(curr_token.type)) {
-        if (try_consume(LBRACKET)) {
-            ParseExpression *subscript = read_expression(PRECEDENCE_LOWEST);
-            ParseExpression *expr = parse_alloc(sizeof(ParseExpression));
-            expr->type = EXPR_SUBSCRIPT;
-            expr->lhs = lhs;
-            expr->rhs = subscript;
-            expect_consume(RBRACKET);
-            lhs = expr;
+    while (is_operator(interp->curr_token.type)) {
+        if (try_consume(interp, LBRACKET)) {
+            ExprId subscript = read_expression(interp, PRECEDENCE_LOWEST);
+            expect_consume(interp, RBRACKET);
+            lhs = new_binary_expr(interp, EXPR_SUBSCRIPT, lhs, subscript);
         } else {
-            int new_precedence = get_precedence(curr_token.type);
+            int new_precedence = get_precedence(interp->curr_token.type);
 
             if (new_precedence < precedence) {
                 break;
             }
 
-            TokenType op_type = curr_token.type;
+            TokenType op_type = interp->curr_token.type;
 
-            if (op_type == EQUAL && !is_lval(lhs)) {
-                error(curr_token.pos, "LHS is not an L-Value (assignable).");
+            if (op_type == EQUAL && !is_lval(interp, lhs)) {
+                error(interp, interp->curr_token.pos,
+                      "LHS is not an L-Value (assignable).");
             }
 
-            bump_token();
+            bump_token(interp);
 
-            ParseExpression *rhs = read_expression(new_precedence +
-                                              is_right_assoc(op_type) ? 0 : 1);
-            ParseExpression *expr = parse_alloc(sizeof(ParseExpression));
-            expr->type = expression_type(op_type);
-            expr->lhs = lhs;
-            expr->rhs = rhs;
-            lhs = expr;
+            ExprId rhs = read_expression(interp, new_precedence +
+                                         is_right_assoc(op_type) ? 0 : 1);
+            lhs = new_binary_expr(interp, expression_type(op_type), lhs, rhs);
         }
     }
 
     return lhs;
 }
 
-ParseExpression *read_literal() {
-    switch (curr_token.type) {
+ExprId read_literal(Interp *interp) {
+    ExprId expr;
+
+    switch (interp->curr_token.type) {
         case MINUS:
-            bump_token();
-            ParseExpression *expr = parse_alloc(sizeof(ParseExpression));
-            expr->type = EXPR_NEGATE;
-            expr->lhs = read_expression(PRECEDENCE_UNARY_NEG);
-            expr->rhs = NULL;
-            return expr;
+            bump_token(interp);
+            expr = read_expression(interp, PRECEDENCE_UNARY_NEG);
+            return new_binary_expr(interp, EXPR_NEGATE, expr, NO_EXPR);
 
         case PLUS:
-            bump_token();
-            return read_expression(PRECEDENCE_UNARY_NEG);
+            bump_token(interp);
+            return read_expression(interp, PRECEDENCE_UNARY_NEG);
 
         case LPAREN:
-            return read_paren_expression();
+            return read_paren_expression(interp);
 
         case LBRACKET:
-            return read_list_literal();
+            return read_list_literal(interp);
 
         case LBRACE:
-            return read_dict_literal();
+            return read_dict_literal(interp);
 
         case IDENT:
-            expr = parse_alloc(sizeof(ParseExpression));
-            expr->type = EXPR_IDENT;
-            expr->string = parse_string_dup(curr_token.string);
-            bump_token();
+            expr = parse_new_expr(interp, EXPR_IDENT);
+            parse_expr(interp, expr)->string = token_string_dup(interp);
+            bump_token(interp);
             return expr;
 
         case FLOAT:
-            expr = parse_alloc(sizeof(ParseExpression));
-            expr->type = EXPR_FLOAT;
-            expr->float_value = curr_token.float_value;
-            bump_token();
+            expr = parse_new_expr(interp, EXPR_FLOAT);
+            parse_expr(interp, expr)->float_value =
+                interp->curr_token.float_value;
+            bump_token(interp);
             return expr;
 
         case STRING:
-            expr = parse_alloc(sizeof(ParseExpression));
-            expr->type = EXPR_STRING;
-            expr->string = parse_string_dup(curr_token.string);
-            bump_token();
+            /* Left in the line, which the compiled code keeps a copy of. */
+            expr = parse_new_expr(interp, EXPR_STRING);
+            parse_expr(interp, expr)->slice.start = interp->curr_token.start;
+            parse_expr(interp, expr)->slice.length =
+                interp->curr_token.length;
+            bump_token(interp);
             return expr;
 
         default:
-            error(curr_token.pos, "Unexpected token while reading ParseExpression "
-                                  "literal.");
-            return NULL;
+            error(interp, interp->curr_token.pos,
+                  "Unexpected token while reading ParseExpression literal.");
+            return NO_EXPR;
     }
 }
 
-ParseExpression *read_paren_expression() {
-    expect_consume(LPAREN);
-    ParseExpression *expr = read_expression(PRECEDENCE_LOWEST);
-    expect_consume(RPAREN);
+ExprId read_paren_expression(Interp *interp) {
+    expect_consume(interp, LPAREN);
+    ExprId expr = read_expression(interp, PRECEDENCE_LOWEST);
+    expect_consume(interp, RPAREN);
     return expr;
 }
 
-ParseExpression *read_list_literal() {
-    // We implicitly reverse the list in this method, but it'll be reversed
-    // when we initialize our list in eval.c!
+/*! Appends `item` to a sibling chain, given the chain's first and last
+    items. */
+void chain_item(Interp *interp, ExprId *first, ExprId *last, ExprId item) {
+    if (*first == NO_EXPR) {
+        *first = item;
+    } else {
+        parse_expr(interp, *last)->next = item;
+    }
 
+    *last = item;
+}
+
+ExprId read_list_literal(Interp *interp) {
     bool first = true;
-    ParseListNode *list = NULL;
-    expect_consume(LBRACKET);
+    ExprId head = NO_EXPR, tail = NO_EXPR;
+    uint32_t length = 0;
+    expect_consume(interp, LBRACKET);
 
-    while (!try_consume(RBRACKET)) {
+    while (!try_consume(interp, RBRACKET)) {
         if (first) {
             first = false;
         } else {
-            expect_consume(COMMA);
+            expect_consume(interp, COMMA);
         }
 
-        ParseListNode *next = parse_alloc(sizeof(ParseListNode));
-        next->next = list;
-        next->expr = read_expression(PRECEDENCE_LOWEST);
-        list = next;
+        chain_item(interp, &head, &tail,
+                   read_expression(interp, PRECEDENCE_LOWEST));
+        length++;
     }
 
-    ParseExpression *expr = parse_alloc(sizeof(ParseExpression));
-    expr->type = EXPR_LIST;
-    expr->list = list;
+    ExprId expr = parse_new_expr(interp, EXPR_LIST);
+    parse_expr(interp, expr)->items.first = head;
+    parse_expr(interp, expr)->items.length = length;
     return expr;
 }
 
-ParseExpression *read_dict_literal() {
+ExprId read_dict_literal(Interp *interp) {
+    // Entries are kept in source order, so later duplicate keys overwrite
+    // earlier ones when the dict is built.
+
     bool first = true;
-    ParseDictNode *dict = NULL;
-    expect_consume(LBRACE);
+    ExprId head = NO_EXPR, tail = NO_EXPR;
+    uint32_t length = 0;
+    expect_consume(interp, LBRACE);
 
-    while (!try_consume(RBRACE)) {
+    while (!try_consume(interp, RBRACE)) {
         if (first) {
             first = false;
         } else {
-            expect_consume(COMMA);
+            expect_consume(interp, COMMA);
         }
 
-        ParseDictNode *next = parse_alloc(sizeof(ParseDictNode));
-        next->next = dict;
-        next->key = read_expression(PRECEDENCE_LOWEST);
-        expect_consume(COLON);
-        next->value = read_expression(PRECEDENCE_LOWEST);
-        dict = next;
+        chain_item(interp, &head, &tail,
+                   read_expression(interp, PRECEDENCE_LOWEST));
+        expect_consume(interp, COLON);
+        chain_item(interp, &head, &tail,
+                   read_expression(interp, PRECEDENCE_LOWEST));
+        length++;
     }
 
-    ParseExpression *expr = parse_alloc(sizeof(ParseExpression));
-    expr->type = EXPR_DICT;
-    expr->dict = dict;
+    ExprId expr = parse_new_expr(interp, EXPR_DICT);
+    parse_expr(interp, expr)->items.first = head;
+    parse_expr(interp, expr)->items.length = length;
     return expr;
 }
 
-bool is_lval(ParseExpression *expr) {
-    return expr->type == EXPR_SUBSCRIPT || expr->type == EXPR_IDENT;
+bool is_lval(Interp *interp, ExprId expr) {
+    return parse_expr(interp, expr)->type == EXPR_SUBSCRIPT ||
+           parse_expr(interp, expr)->type == EXPR_IDENT;
 }
 
-bool is_stmt(ParseExpression *expr) {
-    return expr->type == EXPR_ASSIGN;
+bool is_stmt(Interp *interp, ExprId expr) {
+    return parse_expr(interp, expr)->type == EXPR_ASSIGN;
 }
 
 int get_precedence(TokenType t) {
@@ -11,9 +11,11 @@ enum Precedence {
     PRECEDENCE_LOWEST = 0
 };
 
-ParseStatement *read(char *string);
+ParseStatement *read(Interp *interp, const char *string);
+const char *read_end(Interp *interp);
+int lex_line(Interp *interp, const char *string);
 
 // For `error()`.
-const char *curr_string();
+const char *curr_string(Interp *interp);
 
 #endif /* PARSE_H */
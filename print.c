@@ -0,0 +1,334 @@
+/*! \file
+ * Formats values for printing.  Output is assembled in a growable buffer and
+ * written with a single call, lists and dicts are walked with an explicit
+ * stack, and floats are printed as the shortest decimal that reads back as
+ * the same float, the way Python's repr() does.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "eval.h"
+#include "interp.h"
+#include "print.h"
+#include "dict.h"
+#include "list.h"
+
+/*! Initial capacity of an output buffer. */
+#define OUTBUF_INITIAL_SIZE 4096
+
+/*! Makes room for `len` more bytes in the buffer. */
+static void outbuf_reserve(Interp *interp, OutBuf *buf, size_t len) {
+    if (buf->length + len <= buf->capacity) {
+        return;
+    }
+
+    size_t capacity = buf->capacity == 0 ? OUTBUF_INITIAL_SIZE : buf->capacity;
+
+    while (buf->length + len > capacity) {
+        capacity *= 2;
+    }
+
+    char *data = realloc(buf->data, capacity);
+
+    if (data == NULL) {
+        error(interp, -1, "%s", "Allocation failed!");
+    }
+
+    buf->data = data;
+    buf->capacity = capacity;
+}
+
+void outbuf_append(Interp *interp, OutBuf *buf, const char *str, size_t len) {
+    outbuf_reserve(interp, buf, len);
+    memcpy(buf->data + buf->length, str, len);
+    buf->length += len;
+}
+
+static inline void outbuf_puts(Interp *interp, OutBuf *buf, const char *str) {
+    outbuf_append(interp, buf, str, strlen(str));
+}
+
+/*! Writes out and empties the buffer, keeping its memory. */
+void outbuf_write(OutBuf *buf, FILE *stream) {
+    fwrite(buf->data, 1, buf->length, stream);
+    buf->length = 0;
+}
+
+//// FLOATS ////
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*! x * 10^k, exact for the powers of ten a double holds exactly. */
+static double scale(double x, int k) {
+    while (k > 22) {
+        x *= 1e22;
+        k -= 22;
+    }
+
+    while (k < -22) {
+        x /= 1e22;
+        k += 22;
+    }
+
+    return k >= 0 ? x * powers_of_ten[k] : x / powers_of_ten[-k];
+}
+
+/*!
+ * Finds the shortest digit string that reads back as f, which must be finite
+ * and positive.  Tries 1, 2, ... significant digits in turn: a float never
+ * needs more than 9.  Candidates are evaluated in double precision, whose
+ * 29 extra bits of mantissa make the round-trip check reliable.  Returns the
+ * number of digits, and sets *exponent to the power of ten of the first one.
+ */
+static int shortest_digits(float f, char digits[10], int *exponent) {
+    double x = f;
+    int e = (int) floor(log10(x));
+    uint64_t m = 0;
+    int p;
+
+    // log10() may be off by one near powers of ten.
+    if (scale(1, e) > x) {
+        e--;
+    } else if (scale(1, e + 1) <= x) {
+        e++;
+    }
+
+    for (p = 1; p <= 9; p++) {
+        m = (uint64_t) nearbyint(scale(x, p - 1 - e));
+
+        if ((float) scale(m, e - p + 1) == f) {
+            break;
+        }
+    }
+
+    if (p > 9) {
+        p = 9;
+    }
+
+    // Rounding can carry into an extra digit, e.g. 9.99 to 10.0.
+    if (m >= (uint64_t) powers_of_ten[p]) {
+        m /= 10;
+        e++;
+    }
+
+    for (int i = p - 1; i >= 0; i--) {
+        digits[i] = '0' + m % 10;
+        m /= 10;
+    }
+
+    while (p > 1 && digits[p - 1] == '0') {
+        p--;
+    }
+
+    *exponent = e;
+    return p;
+}
+
+void format_float(Interp *interp, OutBuf *buf, float f) {
+    char digits[10];
+    char out[32];
+    int len = 0, e;
+
+    if (isnan(f)) {
+        outbuf_puts(interp, buf, "nan");
+        return;
+    }
+
+    if (signbit(f)) {
+        out[len++] = '-';
+        f = -f;
+    }
+
+    if (isinf(f)) {
+        memcpy(out + len, "inf", 3);
+        outbuf_append(interp, buf, out, len + 3);
+        return;
+    }
+
+    if (f == 0) {
+        memcpy(out + len, "0.0", 3);
+        outbuf_append(interp, buf, out, len + 3);
+        return;
+    }
+
+    int n = shortest_digits(f, digits, &e);
+
+    if (e < -4 || e >= 16) {
+        // Scientific notation, as in 1.5e-07 or 3e+20.
+        out[len++] = digits[0];
+
+        if (n > 1) {
+            out[len++] = '.';
+            memcpy(out + len, digits + 1, n - 1);
+            len += n - 1;
+        }
+
+        len += sprintf(out + len, "e%c%02d", e < 0 ? '-' : '+', abs(e));
+    } else if (e < 0) {
+        // 0.000ddd
+        out[len++] = '0';
+        out[len++] = '.';
+
+        for (int i = -1; i > e; i--) {
+            out[len++] = '0';
+        }
+
+        memcpy(out + len, digits, n);
+        len += n;
+    } else if (e + 1 >= n) {
+        // ddd000.0
+        memcpy(out + len, digits, n);
+        len += n;
+
+        for (int i = n; i <= e; i++) {
+            out[len++] = '0';
+        }
+
+        out[len++] = '.';
+        out[len++] = '0';
+    } else {
+        // ddd.ddd
+        memcpy(out + len, digits, e + 1);
+        len += e + 1;
+        out[len++] = '.';
+        memcpy(out + len, digits + e + 1, n - e - 1);
+        len += n - e - 1;
+    }
+
+    outbuf_append(interp, buf, out, len);
+}
+
+//// VALUES ////
+
+/*! A list or dict whose items are being printed. */
+typedef struct PrintFrame {
+    RefId ref;
+    int index;
+    int depth;
+} PrintFrame;
+
+/*! Appends a float or string, or opens a list or dict by pushing a frame
+    for its items. */
+static void begin_value(Interp *interp, OutBuf *buf, RefId ref, int depth,
+                        PrintFrame *stack, int *top) {
+    switch (ref_type(interp, ref)) {
+        case VAL_FLOAT:
+            format_float(interp, buf, ref_float(ref));
+            return;
+        case VAL_STRING: {
+            const char *str = deref(interp, ref)->string_value;
+            size_t len = strlen(str);
+
+            outbuf_reserve(interp, buf, len + 2);
+            buf->data[buf->length++] = '"';
+            memcpy(buf->data + buf->length, str, len);
+            buf->length += len;
+            buf->data[buf->length++] = '"';
+            return;
+        }
+        case VAL_LIST:
+            outbuf_puts(interp, buf, "[");
+            break;
+        case VAL_DICT:
+            outbuf_puts(interp, buf, "{");
+            break;
+        default:
+            outbuf_puts(interp, buf, "Unrecognized reference type\n");
+            return;
+    }
+
+    stack[*top] = (PrintFrame) { .ref = ref, .index = 0, .depth = depth };
+    (*top)++;
+}
+
+void format_ref(Interp *interp, OutBuf *buf, RefId ref, int depth) {
+    // Each nested list or dict lowers the depth by one, down to 0.
+    PrintFrame stack[MAX_DEPTH + 1];
+    int top = 0;
+
+    if (depth > MAX_DEPTH) {
+        depth = MAX_DEPTH;
+    }
+
+    begin_value(interp, buf, ref, depth, stack, &top);
+
+    while (top > 0) {
+        PrintFrame *frame = &stack[top - 1];
+        int i = frame->index++;
+
+        if (ref_type(interp, frame->ref) == VAL_LIST) {
+            ListArray *array = deref(interp, frame->ref)->list;
+
+            if (i == array->length) {
+                outbuf_puts(interp, buf, "]");
+                top--;
+                continue;
+            }
+
+            if (i != 0) {
+                outbuf_puts(interp, buf, ", ");
+            }
+
+            if (frame->depth != 0) {
+                begin_value(interp, buf, array->items[i], frame->depth - 1,
+                            stack, &top);
+            } else {
+                outbuf_puts(interp, buf, "...");
+            }
+        } else {
+            DictTable *table = deref(interp, frame->ref)->dict;
+            DictEntry *entry = &dict_entries(table)[i];
+
+            if (i == table->count) {
+                outbuf_puts(interp, buf, "}");
+                top--;
+                continue;
+            }
+
+            if (i != 0) {
+                outbuf_puts(interp, buf, ", ");
+            }
+
+            /* depth irrelevant for keys */
+            begin_value(interp, buf, entry->key, 0, stack, &top);
+            outbuf_puts(interp, buf, ": ");
+
+            if (frame->depth != 0) {
+                begin_value(interp, buf, entry->value, frame->depth - 1,
+                            stack, &top);
+            } else {
+                outbuf_puts(interp, buf, "...");
+            }
+        }
+    }
+}
+
+/*! Prints a value to the session's output with a single write. */
+void print_ref(Interp *interp, RefId ref, bool newline, int depth) {
+    OutBuf *buf = &interp->print_buf;
+    double start = interp->profile ? phase_clock() : 0;
+
+    if (interp->out == NULL) {
+        return;
+    }
+
+    format_ref(interp, buf, ref, depth);
+
+    if (newline) {
+        outbuf_puts(interp, buf, "\n");
+    }
+
+    outbuf_write(buf, interp->out);
+
+    if (interp->profile) {
+        interp->phase_times.print += phase_clock() - start;
+    }
+}
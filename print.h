@@ -0,0 +1,27 @@
+/*! \file
+ * Declarations for formatting values into an output buffer.
+ */
+
+#ifndef PRINT_H
+#define PRINT_H
+
+#include "eval.h"
+
+/*! A growable byte buffer that output is assembled in before being
+    written. */
+typedef struct OutBuf {
+    char *data;
+    size_t length;
+    size_t capacity;
+} OutBuf;
+
+void outbuf_append(Interp *interp, OutBuf *buf, const char *str, size_t len);
+void outbuf_write(OutBuf *buf, FILE *stream);
+
+/* Append the shortest decimal that reads back as exactly f. */
+void format_float(Interp *interp, OutBuf *buf, float f);
+
+/* Append a value, eliding anything nested more than depth levels deep. */
+void format_ref(Interp *interp, OutBuf *buf, RefId ref, int depth);
+
+#endif /* PRINT_H */
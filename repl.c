@@ -4,22 +4,32 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "eval.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "gc.h"
 #include "global.h"
+#include "interp.h"
 #include "myalloc.h"
 #include "parse.h"
+#include "script.h"
+#include "snapshot.h"
 
-void read_eval_print_loop() {
+/*! Size of stdout's buffer when running a script. */
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+void read_eval_print_loop(Interp *interp) {
     char *line;
     size_t size;
 
-    MEMORY_SIZE = 0x0fff;
-    init_myalloc();
-
     while (true) {
         printf("> ");
         line = NULL;
@@ -32,27 +42,224 @@ void read_eval_print_loop() {
             break;
         }
 
-        if (setjmp(error_jmp)) {
-            goto free_loop;
+        interp_run_statement(interp, line, true);
+        free(line);
+    }
+}
+
+/*! Runs every statement in a script file, without prompts or heap dumps,
+    and with output collected in one large buffer. */
+void run_script(Interp *interp, const char *path) {
+    size_t length;
+    const char *text = map_script(path, &length);
+
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    interp_run_script(interp, text);
+    fflush(stdout);
+    unmap_script(text, length);
+}
+
+/*! Parses a byte count with an optional K, M or G suffix. Returns false if
+    the string isn't one. */
+bool parse_size(const char *str, size_t *size) {
+    char *end;
+    unsigned long long value = strtoull(str, &end, 0);
+
+    switch (*end) {
+        case 'k': case 'K': value <<= 10; end++; break;
+        case 'm': case 'M': value <<= 20; end++; break;
+        case 'g': case 'G': value <<= 30; end++; break;
+        default: break;
+    }
+
+    if (end == str || *end != '\0') {
+        return false;
+    }
+
+    *size = value;
+    return true;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--heap-size N] [--max-heap N] [--huge-pages]"
+            " [--gc-trigger PERCENT]\n"
+            "       [--nursery-size N] [--gc-pause MICROSECONDS]"
+            " [--gc-threads N]\n"
+            "       [--background-sweep] [--load-snapshot FILE]"
+            " [--save-snapshot FILE]\n"
+            "       [--profile] [SCRIPT]\n"
+            "Runs SCRIPT without prompts or heap dumps if given, otherwise"
+            " reads stdin.\n"
+            "--load-snapshot starts from the globals saved in FILE;"
+            " --save-snapshot saves\nthem to FILE at the end.\n"
+            "--profile reports throughput, peak sizes and the time in each"
+            " phase on stderr.\n"
+            "Sizes take an optional K, M or G suffix; --max-heap 0 means no"
+            " limit,\n--nursery-size 0 no young generation, and --gc-pause 0"
+            " no incremental marking.\n"
+            "--gc-threads marks full collections on N threads, and"
+            " --background-sweep\nsweeps them on another rather than"
+            " compacting.\n"
+            "Each option can also be set with SUBPYTHON_HEAP_SIZE,"
+            " SUBPYTHON_MAX_HEAP,\nSUBPYTHON_HUGE_PAGES, SUBPYTHON_GC_TRIGGER,"
+            " SUBPYTHON_NURSERY_SIZE,\nSUBPYTHON_GC_PAUSE, SUBPYTHON_GC_THREADS"
+            " and SUBPYTHON_BACKGROUND_SWEEP.\n", prog);
+    exit(1);
+}
+
+/*! Applies one heap setting, from either the environment or the command
+    line. */
+void configure(const char *prog, int option, const char *value) {
+    switch (option) {
+        case 'h':
+            if (!parse_size(value, &MEMORY_SIZE) || MEMORY_SIZE == 0)
+                usage(prog);
+            break;
+        case 'm':
+            if (!parse_size(value, &MAX_MEMORY_SIZE))
+                usage(prog);
+            break;
+        case 'p':
+            HUGE_PAGES = value == NULL || strcmp(value, "0") != 0;
+            break;
+        case 'g':
+            GC_TRIGGER_PERCENT = atoi(value);
+            break;
+        case 'n':
+            if (!parse_size(value, &NURSERY_SIZE))
+                usage(prog);
+            break;
+        case 'u':
+            GC_PAUSE_BUDGET_US = atoi(value);
+            break;
+        case 't':
+            GC_MARK_THREADS = atoi(value);
+            if (GC_MARK_THREADS < 1)
+                usage(prog);
+            break;
+        case 'b':
+            BACKGROUND_SWEEP = value == NULL || strcmp(value, "0") != 0;
+            break;
+        default:
+            usage(prog);
+    }
+}
+
+/*! Reports where a profiled run's time went, and how big it got. */
+void report_profile(Interp *interp, double secs) {
+    PhaseTimes *times = &interp->phase_times;
+
+    fprintf(stderr, "%ld statements in %.3f s: %.0f statements/s\n",
+            interp->statements_run, secs, interp->statements_run / secs);
+    fprintf(stderr, "phases: lex %.3f s, parse %.3f s, eval %.3f s,"
+            " print %.3f s\n", times->lex, times->parse, times->eval,
+            times->print);
+    myalloc_note_peak(interp);
+    fprintf(stderr, "peak heap use: %zu bytes; heap mapped: %zu bytes in %d"
+            " regions; peak ref table: %d refs\n", interp->peak_used,
+            interp->heap_size, interp->num_regions, interp->peak_refs);
+    fprintf(stderr, "collections: %ld minor, %ld full, %ld mark steps;"
+            " longest pause %.3f ms, longest full pause %.3f ms\n",
+            interp->minor_collections, interp->full_collections,
+            interp->mark_steps, interp->max_gc_pause * 1e3,
+            interp->max_final_pause * 1e3);
+}
+
+/*! Reports why a snapshot couldn't be saved or loaded. */
+void snapshot_failed(const char *path) {
+    if (errno == EINVAL) {
+        fprintf(stderr, "%s: not a snapshot from this build\n", path);
+    } else {
+        perror(path);
+    }
+}
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"heap-size", required_argument, NULL, 'h'},
+        {"max-heap", required_argument, NULL, 'm'},
+        {"huge-pages", no_argument, NULL, 'p'},
+        {"gc-trigger", required_argument, NULL, 'g'},
+        {"nursery-size", required_argument, NULL, 'n'},
+        {"gc-pause", required_argument, NULL, 'u'},
+        {"gc-threads", required_argument, NULL, 't'},
+        {"background-sweep", no_argument, NULL, 'b'},
+        {"load-snapshot", required_argument, NULL, 'l'},
+        {"save-snapshot", required_argument, NULL, 's'},
+        {"profile", no_argument, NULL, 'P'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *load_path = NULL, *save_path = NULL;
+    bool profile = false;
+    int option, status = 0;
+
+    /* The environment supplies defaults; flags override them. */
+    if (getenv("SUBPYTHON_HEAP_SIZE") != NULL)
+        configure(argv[0], 'h', getenv("SUBPYTHON_HEAP_SIZE"));
+    if (getenv("SUBPYTHON_MAX_HEAP") != NULL)
+        configure(argv[0], 'm', getenv("SUBPYTHON_MAX_HEAP"));
+    if (getenv("SUBPYTHON_HUGE_PAGES") != NULL)
+        configure(argv[0], 'p', getenv("SUBPYTHON_HUGE_PAGES"));
+    if (getenv("SUBPYTHON_GC_TRIGGER") != NULL)
+        configure(argv[0], 'g', getenv("SUBPYTHON_GC_TRIGGER"));
+    if (getenv("SUBPYTHON_NURSERY_SIZE") != NULL)
+        configure(argv[0], 'n', getenv("SUBPYTHON_NURSERY_SIZE"));
+    if (getenv("SUBPYTHON_GC_PAUSE") != NULL)
+        configure(argv[0], 'u', getenv("SUBPYTHON_GC_PAUSE"));
+    if (getenv("SUBPYTHON_GC_THREADS") != NULL)
+        configure(argv[0], 't', getenv("SUBPYTHON_GC_THREADS"));
+    if (getenv("SUBPYTHON_BACKGROUND_SWEEP") != NULL)
+        configure(argv[0], 'b', getenv("SUBPYTHON_BACKGROUND_SWEEP"));
+
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        if (option == 'l') {
+            load_path = optarg;
+        } else if (option == 's') {
+            save_path = optarg;
+        } else if (option == 'P') {
+            profile = true;
+        } else {
+            configure(argv[0], option, optarg);
         }
+    }
+
+    if (MAX_MEMORY_SIZE != 0 && MAX_MEMORY_SIZE < MEMORY_SIZE) {
+        MAX_MEMORY_SIZE = MEMORY_SIZE;
+    }
+
+    if (optind < argc - 1) {
+        usage(argv[0]);
+    }
 
-        ParseStatement *stmt = read(line);
+    Interp *interp = load_path != NULL ? snapshot_load(load_path, stdout)
+                                       : interp_create(stdout);
 
-        if (stmt == NULL) {
-            goto free_loop;
+    if (interp == NULL) {
+        if (load_path != NULL) {
+            snapshot_failed(load_path);
         }
+        return 1;
+    }
 
-        eval_stmt(stmt);
+    interp->profile = profile;
+    double start = phase_clock();
 
-        memdump();
+    if (optind == argc - 1) {
+        run_script(interp, argv[optind]);
+    } else {
+        read_eval_print_loop(interp);
+    }
 
-free_loop:
-        free(line);
-        parse_free_all();
+    if (profile) {
+        report_profile(interp, phase_clock() - start);
+    }
+
+    if (save_path != NULL && !snapshot_save(interp, save_path)) {
+        snapshot_failed(save_path);
+        status = 1;
     }
-}
 
-int main() {
-    read_eval_print_loop();
-    return 0;
+    interp_destroy(interp);
+    return status;
 }
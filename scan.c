@@ -0,0 +1,158 @@
+/*! \file
+ * Character-class scans used by the lexer to skip whitespace runs,
+ * identifiers and string literals many bytes at a time.
+ *
+ * On x86 the scans test a whole vector of bytes per step: 32 with AVX2 (build
+ * with -mavx2), otherwise 16 with SSE2.  Elsewhere, or when built with
+ * -DSCAN_PORTABLE, they fall back to testing one byte at a time.  Either way
+ * every scan stops at the string's NUL terminator.
+ */
+
+#include <stdint.h>
+
+#include "scan.h"
+
+#if !defined(SCAN_PORTABLE) && defined(__GNUC__) && \
+    (defined(__AVX2__) || defined(__SSE2__))
+#define SCAN_SIMD
+#endif
+
+#ifdef SCAN_SIMD
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+typedef __m256i Chunk;
+#define CHUNK_SIZE 32
+#define chunk_load(p) _mm256_load_si256((const __m256i *) (p))
+#define chunk_splat(c) _mm256_set1_epi8(c)
+#define chunk_eq _mm256_cmpeq_epi8
+#define chunk_gt _mm256_cmpgt_epi8
+#define chunk_or _mm256_or_si256
+#define chunk_and _mm256_and_si256
+#define chunk_mask(v) ((uint32_t) _mm256_movemask_epi8(v))
+#define CHUNK_ALL 0xFFFFFFFFu
+#else
+#include <emmintrin.h>
+
+typedef __m128i Chunk;
+#define CHUNK_SIZE 16
+#define chunk_load(p) _mm_load_si128((const __m128i *) (p))
+#define chunk_splat(c) _mm_set1_epi8(c)
+#define chunk_eq _mm_cmpeq_epi8
+#define chunk_gt _mm_cmpgt_epi8
+#define chunk_or _mm_or_si128
+#define chunk_and _mm_and_si128
+#define chunk_mask(v) ((uint32_t) _mm_movemask_epi8(v))
+#define CHUNK_ALL 0xFFFFu
+#endif
+
+typedef enum ScanKind {
+    SCAN_BLANKS,
+    SCAN_IDENTIFIER,
+    SCAN_QUOTE
+} ScanKind;
+
+/*! Whether each byte of c is in [lo, hi].  The compares are signed, so bytes
+    of 0x80 and up are never in range. */
+static inline Chunk chunk_in_range(Chunk c, char lo, char hi) {
+    return chunk_and(chunk_gt(c, chunk_splat(lo - 1)),
+                     chunk_gt(chunk_splat(hi + 1), c));
+}
+
+/*! A bit per byte of c, set where the scan of the given kind stops. */
+static inline uint32_t stop_mask(Chunk c, ScanKind kind, char quote) {
+    Chunk hit;
+
+    switch (kind) {
+        case SCAN_BLANKS:
+            hit = chunk_or(chunk_eq(c, chunk_splat(' ')),
+                           chunk_eq(c, chunk_splat('\t')));
+            return ~chunk_mask(hit) & CHUNK_ALL;
+
+        case SCAN_IDENTIFIER:
+            /* OR-ing in 0x20 folds upper case onto lower case. */
+            hit = chunk_or(
+                chunk_in_range(chunk_or(c, chunk_splat(0x20)), 'a', 'z'),
+                chunk_or(chunk_in_range(c, '0', '9'),
+                         chunk_eq(c, chunk_splat('_'))));
+            return ~chunk_mask(hit) & CHUNK_ALL;
+
+        default:
+            hit = chunk_or(chunk_eq(c, chunk_splat(quote)),
+                           chunk_or(chunk_eq(c, chunk_splat('\n')),
+                                    chunk_eq(c, chunk_splat('\0'))));
+            return chunk_mask(hit);
+    }
+}
+
+/*!
+ * Returns the first byte at or after p where the scan stops.  Loads are
+ * aligned to the chunk size, so a chunk never crosses a page boundary: the
+ * bytes read before p or past the terminator are in a page that holds part
+ * of the string, and are masked off or never looked at.
+ */
+static inline const char *scan(const char *p, ScanKind kind, char quote) {
+    const char *chunk = (const char *) ((uintptr_t) p &
+                                        -(uintptr_t) CHUNK_SIZE);
+    uint32_t mask = stop_mask(chunk_load(chunk), kind, quote) &
+                    (CHUNK_ALL << (p - chunk));
+
+    while (mask == 0) {
+        chunk += CHUNK_SIZE;
+        mask = stop_mask(chunk_load(chunk), kind, quote);
+    }
+
+    return chunk + __builtin_ctz(mask);
+}
+
+const char *scan_blanks(const char *p) {
+    return scan(p, SCAN_BLANKS, 0);
+}
+
+const char *scan_identifier(const char *p) {
+    return scan(p, SCAN_IDENTIFIER, 0);
+}
+
+const char *scan_quote(const char *p, char quote) {
+    return scan(p, SCAN_QUOTE, quote);
+}
+
+#else /* !SCAN_SIMD */
+
+const char *scan_blanks(const char *p) {
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+
+    return p;
+}
+
+const char *scan_identifier(const char *p) {
+    while ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+           (*p >= '0' && *p <= '9') || *p == '_') {
+        p++;
+    }
+
+    return p;
+}
+
+const char *scan_quote(const char *p, char quote) {
+    while (*p != quote && *p != '\n' && *p != '\0') {
+        p++;
+    }
+
+    return p;
+}
+
+#endif /* SCAN_SIMD */
+
+const char *scan_isa() {
+#if !defined(SCAN_SIMD)
+    return "portable";
+#elif defined(__AVX2__)
+    return "avx2";
+#else
+    return "sse2";
+#endif
+}
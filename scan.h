@@ -0,0 +1,20 @@
+/*! \file
+ * Declarations for the lexer's character-class scans.
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+/* Skip spaces and tabs, returning the first other character. */
+const char *scan_blanks(const char *p);
+
+/* Skip identifier characters ([A-Za-z0-9_]), returning the first other. */
+const char *scan_identifier(const char *p);
+
+/* Find the first `quote`, newline or NUL at or after p. */
+const char *scan_quote(const char *p, char quote);
+
+/* The instruction set the scans were built for, e.g. "sse2". */
+const char *scan_isa();
+
+#endif /* SCAN_H */
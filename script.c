@@ -0,0 +1,49 @@
+/*! \file
+ * Maps script files into memory for batch mode, so that they can be lexed in
+ * place rather than read into a buffer.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "script.h"
+
+/*!
+ * Maps the file at `path` read-only, setting *length to the size of the
+ * mapping.  A zeroed page is reserved after the file, so the text is
+ * NUL-terminated even when its size is a multiple of the page size; the
+ * rest of the file's last page is zero-filled by the kernel.
+ */
+const char *map_script(const char *path, size_t *length) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(path);
+        exit(1);
+    }
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    *length = ((size_t) st.st_size + page) / page * page;
+
+    char *text = mmap(NULL, *length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+
+    if (text == MAP_FAILED || (st.st_size > 0 &&
+            mmap(text, st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0)
+            == MAP_FAILED)) {
+        perror(path);
+        exit(1);
+    }
+
+    close(fd);
+    return text;
+}
+
+void unmap_script(const char *text, size_t length) {
+    munmap((void *) text, length);
+}
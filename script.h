@@ -0,0 +1,16 @@
+/*! \file
+ * Declarations for mapping script files into memory.
+ */
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stddef.h>
+
+/* Map a script read-only, NUL-terminated; exits on failure. */
+const char *map_script(const char *path, size_t *length);
+
+/* Unmap a script mapped by map_script(). */
+void unmap_script(const char *text, size_t length);
+
+#endif /* SCRIPT_H */
@@ -0,0 +1,147 @@
+/*! \file
+ * Runs many independent interpreter sessions on a pool of threads, and
+ * reports their aggregate throughput.  Session i runs the i'th script given,
+ * round-robin; every session has its own heap and globals, and prints
+ * nowhere.
+ *
+ * Usage: subpython-sessions [-t THREADS] [-n SESSIONS] SCRIPT...
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "interp.h"
+#include "script.h"
+
+/*! What the workers share.  Scripts are mapped once and only read. */
+struct Pool {
+    const char **scripts;
+    int num_scripts;
+    int num_sessions;
+    /*! The next session to hand out. */
+    atomic_int next_session;
+    /*! Statements run by finished sessions. */
+    atomic_long statements;
+    /*! Sessions that could not be started. */
+    atomic_int failed;
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-t THREADS] [-n SESSIONS] SCRIPT...\n", prog);
+    exit(2);
+}
+
+/*! Takes sessions off the pool until there are none left. */
+static void *worker(void *arg) {
+    struct Pool *pool = arg;
+    int session;
+
+    while ((session = atomic_fetch_add(&pool->next_session, 1)) <
+           pool->num_sessions) {
+        Interp *interp = interp_create(NULL);
+
+        if (interp == NULL) {
+            atomic_fetch_add(&pool->failed, 1);
+        } else {
+            interp_run_script(interp,
+                              pool->scripts[session % pool->num_scripts]);
+            atomic_fetch_add(&pool->statements, interp->statements_run);
+            interp_destroy(interp);
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_sessions = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "t:n:")) != -1) {
+        switch (option) {
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 'n':
+                num_sessions = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind == argc || num_threads < 1 || num_sessions < 0) {
+        usage(argv[0]);
+    }
+
+    struct Pool pool;
+    int num_scripts = argc - optind;
+    size_t *lengths = malloc(sizeof(size_t) * num_scripts);
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+
+    pool.scripts = malloc(sizeof(char *) * num_scripts);
+    if (lengths == NULL || threads == NULL || pool.scripts == NULL) {
+        fprintf(stderr, "Allocation failed!\n");
+        return 1;
+    }
+
+    for (int i = 0; i < num_scripts; i++) {
+        pool.scripts[i] = map_script(argv[optind + i], &lengths[i]);
+    }
+
+    pool.num_scripts = num_scripts;
+    pool.num_sessions = num_sessions == 0 ? num_scripts : num_sessions;
+    atomic_init(&pool.next_session, 0);
+    atomic_init(&pool.statements, 0);
+    atomic_init(&pool.failed, 0);
+
+    struct timespec start, end;
+    int started = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (; started < num_threads; started++) {
+        if (pthread_create(&threads[started], NULL, worker, &pool) != 0) {
+            fprintf(stderr, "Could not start thread %d.\n", started);
+            break;
+        }
+    }
+
+    if (started == 0) {
+        return 1;
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec) +
+                  (end.tv_nsec - start.tv_nsec) / 1e9;
+    long statements = atomic_load(&pool.statements);
+    int failed = atomic_load(&pool.failed);
+
+    printf("%d sessions on %d threads: %ld statements in %.3f s, "
+           "%.0f statements/s\n", pool.num_sessions - failed, started,
+           statements, secs, statements / secs);
+
+    if (failed != 0) {
+        fprintf(stderr, "%d sessions could not be created.\n", failed);
+    }
+
+    for (int i = 0; i < num_scripts; i++) {
+        unmap_script(pool.scripts[i], lengths[i]);
+    }
+
+    free(pool.scripts);
+    free(lengths);
+    free(threads);
+    return failed != 0;
+}
@@ -0,0 +1,280 @@
+/*! \file
+ * Heap snapshots.  A snapshot holds everything a session's globals can reach:
+ * the live pool blocks, the reference table and the global variables.  Values
+ * refer to each other by RefId rather than by address, so the blocks are
+ * saved as they are and mapped straight back in; only each reference's
+ * pointer to its own block is rewritten on loading.
+ *
+ * The file is the header, then the heap image at SNAPSHOT_ALIGN, then one
+ * SnapshotRef per reference slot and one SnapshotVar (followed by its name)
+ * per bound global, starting at the next SNAPSHOT_ALIGN boundary.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "interp.h"
+#include "gc.h"
+#include "myalloc.h"
+#include "symtab.h"
+
+/*! Identifies a snapshot, and the version of its format. */
+#define SNAPSHOT_MAGIC "SUBPYSN1"
+
+/*! The heap image is aligned to this, so that it can be mapped with any page
+    size up to it. */
+#define SNAPSHOT_ALIGN 65536
+
+typedef struct SnapshotHeader {
+    char magic[8];
+    /*! sizeof(void *) where it was saved; blocks hold native layouts. */
+    uint32_t word_size;
+    uint32_t num_refs, num_vars;
+    uint64_t heap_length;
+    /*! Where the reference records start. */
+    uint64_t refs_offset;
+} SnapshotHeader;
+
+typedef struct SnapshotRef {
+    uint8_t occupied;
+    uint8_t type;
+    /*! Offset of the block's payload in the heap image, or -1 if none. */
+    int64_t payload;
+} SnapshotRef;
+
+typedef struct SnapshotVar {
+    RefId ref;
+    uint32_t name_length;
+} SnapshotVar;
+
+static uint64_t align_up(uint64_t offset) {
+    return (offset + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+/*! Writes the reference and variable records after the heap image. */
+static bool save_records(Interp *interp, FILE *file, SnapshotHeader *header,
+                         const int64_t *offsets) {
+    for (int i = 0; i < interp->num_refs; i++) {
+        SnapshotRef record = {
+            .occupied = interp->ref_table[i].occupied,
+            .type = interp->ref_table[i].type,
+            .payload = offsets[i]
+        };
+
+        if (fwrite(&record, sizeof(record), 1, file) != 1) {
+            return false;
+        }
+    }
+
+    header->num_vars = 0;
+    for (int i = 0; i < interp->num_vars; i++) {
+        struct GlobalVariable *var = &interp->global_vars[i];
+        SnapshotVar record = { .ref = var->ref };
+
+        if (var->name == NULL || var->ref == -1) {
+            continue;
+        }
+
+        record.name_length = strlen(var->name);
+        if (fwrite(&record, sizeof(record), 1, file) != 1 ||
+            fwrite(var->name, 1, record.name_length, file) !=
+                record.name_length) {
+            return false;
+        }
+        header->num_vars++;
+    }
+
+    return true;
+}
+
+/*!
+ * Collects garbage, then saves the session's globals and everything they
+ * reach to `path`.  Must be called between statements.  Sets errno and
+ * returns false on failure.
+ */
+bool snapshot_save(Interp *interp, const char *path) {
+    if (setjmp(interp->error_jmp)) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    collect_garbage(interp);
+
+    SnapshotHeader header = {
+        .word_size = sizeof(void *),
+        .num_refs = interp->num_refs
+    };
+    int64_t *offsets = malloc(sizeof(int64_t) * (interp->num_refs + 1));
+    FILE *file = fopen(path, "wb");
+    bool ok = offsets != NULL && file != NULL;
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    for (int i = 0; ok && i < interp->num_refs; i++) {
+        offsets[i] = -1;
+    }
+
+    ok = ok && fseek(file, SNAPSHOT_ALIGN, SEEK_SET) == 0 &&
+         myalloc_save_image(interp, file, offsets, &header.heap_length);
+
+    header.refs_offset = align_up(SNAPSHOT_ALIGN + header.heap_length);
+    ok = ok && fseek(file, header.refs_offset, SEEK_SET) == 0 &&
+         save_records(interp, file, &header, offsets) &&
+         fseek(file, 0, SEEK_SET) == 0 &&
+         fwrite(&header, sizeof(header), 1, file) == 1;
+
+    int saved_errno = offsets == NULL ? ENOMEM : errno;
+
+    if (file != NULL && fclose(file) != 0) {
+        ok = false;
+        saved_errno = errno;
+    }
+
+    free(offsets);
+    errno = saved_errno;
+    return ok;
+}
+
+/*! Reads the reference records into the table, pointing each at its block,
+    and rebuilds the free list.  Returns false if any is inconsistent. */
+static bool load_refs(Interp *interp, FILE *file, SnapshotHeader *header) {
+    unsigned char *heap = interp->regions[0].start;
+    int max_refs = header->num_refs > INITIAL_SIZE ? header->num_refs
+                                                   : INITIAL_SIZE;
+
+    interp->ref_table = malloc(sizeof(struct Reference) * max_refs);
+    if (interp->ref_table == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    interp->max_refs = max_refs;
+    interp->num_refs = interp->peak_refs = header->num_refs;
+
+    for (int i = 0; i < interp->num_refs; i++) {
+        Reference *r = &interp->ref_table[i];
+        SnapshotRef record;
+
+        if (fread(&record, sizeof(record), 1, file) != 1 ||
+            record.type > VAL_EMPTY ||
+            record.payload >= (int64_t) header->heap_length) {
+            errno = EINVAL;
+            return false;
+        }
+
+        r->occupied = record.occupied;
+        r->marked = false;
+        r->old = true;
+        r->remembered = false;
+        r->type = record.type;
+        r->string_value = NULL;
+
+        if (record.occupied && record.payload >= 0) {
+            relocate_payload(interp, i, heap + record.payload);
+        }
+    }
+
+    interp->free_refs = -1;
+    for (int i = interp->num_refs - 1; i >= 0; i--) {
+        if (!interp->ref_table[i].occupied) {
+            interp->ref_table[i].next_free = interp->free_refs;
+            interp->free_refs = i;
+        }
+    }
+
+    return true;
+}
+
+/*! Rebinds the saved global variables.  Returns false if any is
+    inconsistent. */
+static bool load_vars(Interp *interp, FILE *file, SnapshotHeader *header) {
+    char *volatile name = NULL;
+
+    if (setjmp(interp->error_jmp)) {
+        free(name);
+        errno = ENOMEM;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header->num_vars; i++) {
+        SnapshotVar record;
+
+        if (fread(&record, sizeof(record), 1, file) != 1 ||
+            (!is_float_ref(record.ref) &&
+             (record.ref < 0 || record.ref >= interp->num_refs))) {
+            errno = EINVAL;
+            return false;
+        }
+
+        name = malloc((size_t) record.name_length + 1);
+        if (name == NULL) {
+            errno = ENOMEM;
+            return false;
+        }
+
+        if (fread(name, 1, record.name_length, file) != record.name_length) {
+            free(name);
+            errno = EINVAL;
+            return false;
+        }
+
+        name[record.name_length] = '\0';
+        *get_global_variable(interp, name, true) = record.ref;
+        free(name);
+        name = NULL;
+    }
+
+    return true;
+}
+
+/*!
+ * Starts a session, printing to `out`, from the snapshot at `path`.  The
+ * heap image is mapped copy-on-write rather than read, so the cost of
+ * loading is in the reference table and globals alone.  Sets errno and
+ * returns NULL on failure; EINVAL means the file isn't a snapshot, or is one
+ * from a different build.
+ */
+Interp *snapshot_load(const char *path, FILE *out) {
+    FILE *file = fopen(path, "rb");
+    SnapshotHeader header;
+    Interp *interp = NULL;
+    int saved_errno;
+
+    if (file == NULL) {
+        return NULL;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.word_size != sizeof(void *)) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    interp = interp_create(out);
+    if (interp == NULL) {
+        errno = ENOMEM;
+        goto fail;
+    }
+
+    if (!myalloc_load_image(interp, fileno(file), SNAPSHOT_ALIGN,
+                            header.heap_length) ||
+        fseek(file, header.refs_offset, SEEK_SET) != 0 ||
+        !load_refs(interp, file, &header) ||
+        !load_vars(interp, file, &header)) {
+        goto fail;
+    }
+
+    fclose(file);
+    return interp;
+
+fail:
+    saved_errno = errno;
+    if (interp != NULL) {
+        interp_destroy(interp);
+    }
+    fclose(file);
+    errno = saved_errno;
+    return NULL;
+}
@@ -0,0 +1,22 @@
+/*! \file
+ * Declarations for saving a session's state to a file and starting new
+ * sessions from it.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "global.h"
+
+/* Collect, then save the globals and everything they reach; sets errno and
+   returns false on failure. */
+bool snapshot_save(Interp *interp, const char *path);
+
+/* Start a session from a saved snapshot; sets errno and returns NULL on
+   failure, with EINVAL meaning the file isn't a snapshot from this build. */
+Interp *snapshot_load(const char *path, FILE *out);
+
+#endif /* SNAPSHOT_H */
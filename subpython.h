@@ -0,0 +1,130 @@
+/*! \file
+ * The embedding API of libsubpython.  A host creates any number of sessions,
+ * evaluates source in them, and reads the values of their globals through
+ * handles.  Nothing here prints unless the host supplies a stream, and no
+ * error escapes a call: every failure comes back as a SubpythonStatus.
+ *
+ * A session may be used from any thread, but by one thread at a time.
+ */
+
+#ifndef SUBPYTHON_H
+#define SUBPYTHON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SUBPYTHON_API __attribute__((visibility("default")))
+
+/*! An interpreter session. */
+typedef struct Interp Subpython;
+
+/*!
+ * A handle to a value in a session.  A handle dies at the session's next
+ * subpython_eval(): the source may unbind or collect the value, and its slot
+ * may then be reused for another one.  Handles carry no generation, so a dead
+ * handle is not reliably caught; it may read some other value instead of
+ * returning SUBPYTHON_INVALID_HANDLE.  Look globals up again after each eval.
+ * The other calls, subpython_dict_get() included, keep handles alive.
+ */
+typedef int64_t SubpythonValue;
+
+typedef enum SubpythonStatus {
+    SUBPYTHON_OK = 0,
+    /*! The source raised an error; see subpython_error(). */
+    SUBPYTHON_ERROR,
+    /*! No such global variable, or no such dict key. */
+    SUBPYTHON_NOT_FOUND,
+    /*! The value is not of the type the call reads. */
+    SUBPYTHON_TYPE_ERROR,
+    /*! A list or dict index is out of range. */
+    SUBPYTHON_INDEX_ERROR,
+    /*! The handle does not refer to a live value. */
+    SUBPYTHON_INVALID_HANDLE
+} SubpythonStatus;
+
+typedef enum SubpythonType {
+    SUBPYTHON_FLOAT,
+    SUBPYTHON_STRING,
+    SUBPYTHON_LIST,
+    SUBPYTHON_DICT,
+    SUBPYTHON_NONE
+} SubpythonType;
+
+/*! Creates a session.  Values printed by expression statements, and error
+    reports, are written to `out`, or discarded if it is NULL.  Returns NULL
+    if the session's heap can't be had. */
+SUBPYTHON_API Subpython *subpython_create(FILE *out);
+SUBPYTHON_API void subpython_destroy(Subpython *session);
+
+/*! Saves the session's globals, and everything they reach, to a file. */
+SUBPYTHON_API SubpythonStatus subpython_save(Subpython *session,
+                                             const char *path);
+/*! Creates a session from a file written by subpython_save(), much faster
+    than replaying the source that built it.  Returns NULL, with errno set,
+    if the file can't be loaded. */
+SUBPYTHON_API Subpython *subpython_restore(const char *path, FILE *out);
+
+/*! Runs the statements of a NUL-terminated source buffer, stopping at the
+    first that raises an error. */
+SUBPYTHON_API SubpythonStatus subpython_eval(Subpython *session,
+                                             const char *source);
+/*! The message of the latest error the session raised, or "". */
+SUBPYTHON_API const char *subpython_error(Subpython *session);
+
+/*! Reads a global variable.  An unbound name is SUBPYTHON_NOT_FOUND, and
+    leaves subpython_error() as it was. */
+SUBPYTHON_API SubpythonStatus subpython_global(Subpython *session,
+                                               const char *name,
+                                               SubpythonValue *value);
+/*! The value's type; SUBPYTHON_NONE for an invalid handle. */
+SUBPYTHON_API SubpythonType subpython_type(Subpython *session,
+                                           SubpythonValue value);
+
+SUBPYTHON_API SubpythonStatus subpython_float(Subpython *session,
+                                              SubpythonValue value,
+                                              float *f);
+/*! Copies a string into `buf`, truncated to `size` - 1 bytes and
+    NUL-terminated; `*length`, if given, receives its full length. */
+SUBPYTHON_API SubpythonStatus subpython_string(Subpython *session,
+                                               SubpythonValue value,
+                                               char *buf, size_t size,
+                                               size_t *length);
+
+SUBPYTHON_API SubpythonStatus subpython_list_length(Subpython *session,
+                                                    SubpythonValue list,
+                                                    size_t *length);
+SUBPYTHON_API SubpythonStatus subpython_list_get(Subpython *session,
+                                                 SubpythonValue list,
+                                                 size_t index,
+                                                 SubpythonValue *item);
+
+SUBPYTHON_API SubpythonStatus subpython_dict_length(Subpython *session,
+                                                    SubpythonValue dict,
+                                                    size_t *length);
+/*! Reads the index'th entry of a dict, in insertion order. */
+SUBPYTHON_API SubpythonStatus subpython_dict_entry(Subpython *session,
+                                                   SubpythonValue dict,
+                                                   size_t index,
+                                                   SubpythonValue *key,
+                                                   SubpythonValue *value);
+/*! Looks up a string key. */
+SUBPYTHON_API SubpythonStatus subpython_dict_get(Subpython *session,
+                                                 SubpythonValue dict,
+                                                 const char *key,
+                                                 SubpythonValue *value);
+/*! Looks up a float key. */
+SUBPYTHON_API SubpythonStatus subpython_dict_get_float(Subpython *session,
+                                                       SubpythonValue dict,
+                                                       float key,
+                                                       SubpythonValue *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SUBPYTHON_H */
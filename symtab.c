@@ -0,0 +1,219 @@
+/*! \file
+ * The global symbol table: variable records in a stable array, found through
+ * an open-addressing hash index over their names.  Deleting a variable leaves
+ * a tombstone in the index and returns its record to a free list.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "eval.h"
+#include "symtab.h"
+#include "interp.h"
+
+/*!
+ * Hash index over the records (Interp.var_index): each slot holds a record
+ * index, INDEX_EMPTY or INDEX_TOMBSTONE.  `index_used` counts tombstones too,
+ * since they lengthen probe sequences just like live entries.
+ *
+ * Interp.symtab_epoch is bumped by every deletion.  A slot cached in a
+ * GlobalRef is only trusted while its epoch matches, since deletion may hand
+ * the record to a different name.
+ */
+#define INDEX_EMPTY -1
+#define INDEX_TOMBSTONE -2
+
+/*! Rebuilds the index with `capacity` slots, dropping all tombstones. */
+static void rebuild_index(Interp *interp, int capacity) {
+    int *index = malloc(sizeof(int) * capacity);
+
+    if (index == NULL) {
+        error(interp, -1, "%s", "Allocation failed!");
+    }
+
+    for (int i = 0; i < capacity; i++) {
+        index[i] = INDEX_EMPTY;
+    }
+
+    interp->index_used = 0;
+    for (int i = 0; i < interp->num_vars; i++) {
+        if (interp->global_vars[i].name != NULL) {
+            unsigned int slot = interp->global_vars[i].hash & (capacity - 1);
+
+            while (index[slot] != INDEX_EMPTY) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+
+            index[slot] = i;
+            interp->index_used++;
+        }
+    }
+
+    free(interp->var_index);
+    interp->var_index = index;
+    interp->index_capacity = capacity;
+}
+
+/*!
+ * Finds the index slot holding `name`.  Returns it, or -1 if the name is
+ * absent; `*insert_at` then receives the slot an insertion should use (the
+ * first tombstone on the probe sequence, if any).
+ */
+static int find_slot(Interp *interp, const char *name, unsigned int hash,
+                     int *insert_at) {
+    unsigned int slot = hash & (interp->index_capacity - 1);
+    int tombstone = -1;
+
+    while (interp->var_index[slot] != INDEX_EMPTY) {
+        if (interp->var_index[slot] == INDEX_TOMBSTONE) {
+            if (tombstone == -1) {
+                tombstone = slot;
+            }
+        } else {
+            struct GlobalVariable *var =
+                &interp->global_vars[interp->var_index[slot]];
+
+            if (var->hash == hash && strcmp(var->name, name) == 0) {
+                return slot;
+            }
+        }
+
+        slot = (slot + 1) & (interp->index_capacity - 1);
+    }
+
+    *insert_at = tombstone != -1 ? tombstone : (int) slot;
+    return -1;
+}
+
+/*! Takes a record off the free list, or the end of the array. */
+static int new_record(Interp *interp) {
+    if (interp->free_vars != -1) {
+        int i = interp->free_vars;
+        interp->free_vars = interp->global_vars[i].next_free;
+        return i;
+    }
+
+    if (interp->num_vars == interp->max_vars) {
+        /* Double its size (the JVM internal source said this was a good
+         * resizing semantic, don't sue me!). */
+        interp->max_vars = interp->max_vars == 0 ? INITIAL_SIZE
+                                                 : interp->max_vars * 2;
+        interp->global_vars = realloc(interp->global_vars,
+                                      sizeof(struct GlobalVariable) *
+                                      interp->max_vars);
+
+        if (interp->global_vars == NULL) {
+            error(interp, -1, "%s", "Allocation failed!");
+        }
+    }
+
+    return interp->num_vars++;
+}
+
+/*!
+ * Returns the record index of the variable `name`, creating it (unbound, with
+ * a ref of -1) if `create` is true, or -1 if it doesn't exist.  Only a
+ * creating lookup can raise an error.
+ */
+int resolve_global(Interp *interp, const char *name, bool create) {
+    unsigned int hash = hash_string(name);
+    int insert_at;
+
+    if (interp->index_capacity == 0) {
+        if (!create) {
+            return -1;
+        }
+
+        rebuild_index(interp, INITIAL_SIZE);
+    }
+
+    int slot = find_slot(interp, name, hash, &insert_at);
+
+    if (slot != -1) {
+        return interp->var_index[slot];
+    } else if (!create) {
+        return -1;
+    }
+
+    /* Keep the index at most 2/3 full, tombstones included. */
+    if ((interp->index_used + 1) * 3 > interp->index_capacity * 2) {
+        int capacity = interp->index_capacity;
+
+        while ((interp->num_vars + 1) * 3 > capacity * 2) {
+            capacity *= 2;
+        }
+
+        rebuild_index(interp, capacity);
+        find_slot(interp, name, hash, &insert_at);
+    }
+
+    int i = new_record(interp);
+    interp->global_vars[i].name = strdup(name);
+    interp->global_vars[i].hash = hash;
+    interp->global_vars[i].ref = -1;
+
+    if (interp->global_vars[i].name == NULL) {
+        error(interp, -1, "%s", "Allocation failed!");
+    }
+
+    if (interp->var_index[insert_at] == INDEX_EMPTY) {
+        interp->index_used++;
+    }
+    interp->var_index[insert_at] = i;
+    return i;
+}
+
+/*! Tries to retrieve a global variable's reference, creating it if `create`
+    is true. */
+RefId *get_global_variable(Interp *interp, char *name, bool create) {
+    int i = resolve_global(interp, name, create);
+
+    if (i == -1 || (!create && interp->global_vars[i].ref == -1)) {
+        error(interp, -1, "Could not retrieve variable `%s`", name);
+    }
+
+    return &interp->global_vars[i].ref;
+}
+
+/*! Like get_global_variable, for a name in compiled code: the record found
+    is cached in `ref`, so looking it up again skips hashing entirely. */
+RefId *get_global_variable_cached(Interp *interp, GlobalRef *ref, bool create) {
+    if (ref->slot == -1 || ref->epoch != interp->symtab_epoch) {
+        ref->slot = resolve_global(interp, ref->name, create);
+        ref->epoch = interp->symtab_epoch;
+
+        if (ref->slot == -1) {
+            error(interp, -1, "Could not retrieve variable `%s`", ref->name);
+        }
+    }
+
+    if (!create && interp->global_vars[ref->slot].ref == -1) {
+        error(interp, -1, "Could not retrieve variable `%s`", ref->name);
+    }
+
+    return &interp->global_vars[ref->slot].ref;
+}
+
+/*! Delete the global variable with name `name`. Error if no such variable
+    exists. */
+void delete_global_variable(Interp *interp, char *name) {
+    int insert_at;
+    int slot = interp->index_capacity == 0 ? -1 :
+               find_slot(interp, name, hash_string(name), &insert_at);
+
+    if (slot == -1) {
+        error(interp, -1, "Could not delete variable `%s`", name);
+    }
+
+    int i = interp->var_index[slot];
+    interp->var_index[slot] = INDEX_TOMBSTONE;
+
+    free(interp->global_vars[i].name);
+    interp->global_vars[i].name = NULL;
+    interp->global_vars[i].ref = -1;
+    interp->global_vars[i].next_free = interp->free_vars;
+    interp->free_vars = i;
+
+    interp->symtab_epoch++;
+}
@@ -0,0 +1,40 @@
+/*! \file
+ * Declarations for the global symbol table.
+ */
+
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "eval.h"
+
+/*!
+ * A global variable.  Records never move within global_vars once created, so
+ * an index into it (a "slot") can be cached by parsed identifiers.  A deleted
+ * variable's record has a NULL name and sits on a free list for reuse.
+ */
+struct GlobalVariable {
+    /*! The symbol table's own copy of the name. */
+    char *name;
+    unsigned int hash;
+    RefId ref;
+    /*! Next free record, while this one is on the free list. */
+    int next_free;
+};
+
+/*!
+ * A reference to a global by name, as held by compiled code: the record it
+ * resolved to is cached (-1 until first use) along with the symbol table epoch
+ * it was resolved in.
+ */
+typedef struct GlobalRef {
+    char *name;
+    int slot;
+    unsigned int epoch;
+} GlobalRef;
+
+int resolve_global(Interp *interp, const char *name, bool create);
+RefId *get_global_variable(Interp *interp, char *name, bool create);
+RefId *get_global_variable_cached(Interp *interp, GlobalRef *ref, bool create);
+void delete_global_variable(Interp *interp, char *name);
+
+#endif /* SYMTAB_H */
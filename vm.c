@@ -0,0 +1,252 @@
+/*! \file
+ * A stack VM for compiled statements.  With GCC and Clang, dispatch is
+ * threaded: every instruction jumps straight to the handler of the next one
+ * through a table of label addresses.  Other compilers fall back to a switch
+ * in a loop.
+ */
+
+#include <stdio.h>
+
+#include "global.h"
+#include "eval.h"
+#include "interp.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "dict.h"
+#include "list.h"
+#include "symtab.h"
+#include "gc.h"
+#include "bgsweep.h"
+
+#if defined(__GNUC__)
+#define THREADED_DISPATCH
+#endif
+
+/*! Pops two floats for an arithmetic instruction, erroring on non-floats. */
+#define FLOAT_OPERANDS(lhs, rhs)                                              \
+    if (!is_float_ref(sp[-2]) || !is_float_ref(sp[-1])) {                     \
+        error(interp, -1, "%s", "Expected numerical (float) value.");        \
+    }                                                                         \
+    float lhs = ref_float(sp[-2]), rhs = ref_float(sp[-1]);                   \
+    sp--
+
+/*! Executes a compiled statement. */
+void run_code(Interp *interp, Code *code) {
+    if (interp->vm_stack_size < code->max_stack) {
+        interp->vm_stack_size = code->max_stack;
+        interp->vm_stack = realloc(interp->vm_stack,
+                                   sizeof(RefId) * interp->vm_stack_size);
+
+        if (interp->vm_stack == NULL) {
+            error(interp, -1, "%s", "Allocation failed!");
+        }
+    }
+
+    uint32_t *pc = code->ops;
+    RefId *sp = interp->vm_stack;
+    interp->vm_sp = sp;
+
+#ifdef THREADED_DISPATCH
+    /* Label addresses and computed gotos are GNU extensions, which -pedantic
+     * would flag; the warning is silenced for them alone. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    static void *dispatch[NUM_OPCODES] = {
+        [OP_PUSH_FLOAT] = &&op_push_float,
+        [OP_PUSH_STRING] = &&op_push_string,
+        [OP_LOAD_GLOBAL] = &&op_load_global,
+        [OP_STORE_GLOBAL] = &&op_store_global,
+        [OP_SUBSCRIPT] = &&op_subscript,
+        [OP_STORE_SUBSCRIPT] = &&op_store_subscript,
+        [OP_NEGATE] = &&op_negate,
+        [OP_ADD] = &&op_add,
+        [OP_SUB] = &&op_sub,
+        [OP_MULT] = &&op_mult,
+        [OP_DIV] = &&op_div,
+        [OP_BUILD_LIST] = &&op_build_list,
+        [OP_BUILD_DICT] = &&op_build_dict,
+        [OP_PRINT] = &&op_print,
+        [OP_POP] = &&op_pop,
+        [OP_DELETE_GLOBAL] = &&op_delete_global,
+        [OP_GC] = &&op_gc,
+        [OP_RETURN] = &&op_return,
+    };
+#pragma GCC diagnostic pop
+#define TARGET(op, label) label:
+#define NEXT()                                                                \
+    _Pragma("GCC diagnostic push")                                            \
+    _Pragma("GCC diagnostic ignored \"-Wpedantic\"")                          \
+    goto *dispatch[*pc++];                                                    \
+    _Pragma("GCC diagnostic pop")
+    NEXT();
+#else
+#define TARGET(op, label) case op:
+#define NEXT() continue
+    for (;;) switch (*pc++) {
+#endif
+
+    TARGET(OP_PUSH_FLOAT, op_push_float)
+        *sp++ = FLOAT_TAG | *pc++;
+        NEXT();
+
+    TARGET(OP_PUSH_STRING, op_push_string)
+        interp->vm_sp = sp;
+        *sp = make_reference_slice(interp, code->text + pc[0], pc[1]);
+        sp++;
+        pc += 2;
+        NEXT();
+
+    TARGET(OP_LOAD_GLOBAL, op_load_global)
+        *sp++ = *get_global_variable_cached(interp, &code->names[*pc++], false);
+        NEXT();
+
+    TARGET(OP_STORE_GLOBAL, op_store_global)
+        *get_global_variable_cached(interp, &code->names[*pc++], true) = sp[-1];
+        NEXT();
+
+    TARGET(OP_SUBSCRIPT, op_subscript) {
+        RefId container = sp[-2], key = sp[-1], value;
+
+        if (ref_type(interp, container) == VAL_LIST) {
+            /* If we have a list, then floor the float to make an index.
+             * (it's the best we can do... without reintroducing ints.) */
+            if (!is_float_ref(key)) {
+                error(interp, -1, "%s", "Expected numerical (float) value.");
+            }
+            value = *list_get_lval(interp, container, (int) ref_float(key));
+        } else if (ref_type(interp, container) == VAL_DICT) {
+            value = dict_get(interp, container, key);
+
+            /* If we got -1, then that means our key is missing. */
+            if (value == -1) {
+                error(interp, -1, "%s", "Key cannot be found!");
+            }
+        } else {
+            error(interp, -1, "%s",
+                  "Can only subscript lists and dictionaries.");
+        }
+
+        sp[-2] = value;
+        sp--;
+        NEXT();
+    }
+
+    TARGET(OP_STORE_SUBSCRIPT, op_store_subscript) {
+        /* Everything stays on the stack until the store is done, since
+         * inserting a dict key may collect. */
+        RefId value = sp[-3], container = sp[-2], key = sp[-1];
+        interp->vm_sp = sp;
+
+        if (ref_type(interp, container) == VAL_LIST) {
+            if (!is_float_ref(key)) {
+                error(interp, -1, "%s", "Expected numerical (float) value.");
+            }
+            *list_get_lval(interp, container, (int) ref_float(key)) = value;
+        } else if (ref_type(interp, container) == VAL_DICT) {
+            /* A missing key is inserted. */
+            *dict_get_lval(interp, container, key) = value;
+        } else {
+            error(interp, -1, "%s",
+                  "Can only subscript lists and dictionaries.");
+        }
+        gc_write_barrier(interp, container, value);
+
+        sp -= 2;
+        NEXT();
+    }
+
+    TARGET(OP_NEGATE, op_negate)
+        if (!is_float_ref(sp[-1])) {
+            error(interp, -1, "%s", "Expected numerical (float) value.");
+        }
+        sp[-1] = make_reference_float(-ref_float(sp[-1]));
+        NEXT();
+
+    TARGET(OP_ADD, op_add) {
+        FLOAT_OPERANDS(lhs, rhs);
+        sp[-1] = make_reference_float(lhs + rhs);
+        NEXT();
+    }
+
+    TARGET(OP_SUB, op_sub) {
+        FLOAT_OPERANDS(lhs, rhs);
+        sp[-1] = make_reference_float(lhs - rhs);
+        NEXT();
+    }
+
+    TARGET(OP_MULT, op_mult) {
+        FLOAT_OPERANDS(lhs, rhs);
+        sp[-1] = make_reference_float(lhs * rhs);
+        NEXT();
+    }
+
+    TARGET(OP_DIV, op_div) {
+        FLOAT_OPERANDS(lhs, rhs);
+        sp[-1] = make_reference_float(lhs / rhs);
+        NEXT();
+    }
+
+    TARGET(OP_BUILD_LIST, op_build_list) {
+        int length = *pc++;
+        interp->vm_sp = sp;
+
+        RefId list = make_reference_list(interp, length);
+        for (int i = 0; i < length; i++) {
+            list_append(interp, list, sp[i - length]);
+        }
+
+        sp -= length;
+        *sp++ = list;
+        NEXT();
+    }
+
+    TARGET(OP_BUILD_DICT, op_build_dict) {
+        int num_entries = *pc++;
+        interp->vm_sp = sp;
+
+        RefId dict = make_reference_dict(interp, num_entries);
+        for (RefId *entry = sp - 2 * num_entries; entry < sp; entry += 2) {
+            RefId value = entry[1];
+            *dict_get_lval(interp, dict, entry[0]) = value;
+            gc_write_barrier(interp, dict, value);
+        }
+
+        sp -= 2 * num_entries;
+        *sp++ = dict;
+        NEXT();
+    }
+
+    TARGET(OP_PRINT, op_print)
+        print_ref(interp, *--sp, true, MAX_DEPTH);
+        NEXT();
+
+    TARGET(OP_POP, op_pop)
+        sp--;
+        NEXT();
+
+    TARGET(OP_DELETE_GLOBAL, op_delete_global)
+        delete_global_variable(interp, code->names[*pc++].name);
+        NEXT();
+
+    TARGET(OP_GC, op_gc) {
+        interp->vm_sp = sp;
+        GCStats stats = collect_garbage(interp);
+        /* Report what a background sweep frees too. */
+        bgsweep_finish(interp, &stats);
+        if (interp->out != NULL) {
+            fprintf(interp->out, "Garbage collector invoked! Freed %zu bytes "
+                    "and %d refs.\n", stats.bytes_freed, stats.refs_freed);
+        }
+        NEXT();
+    }
+
+    TARGET(OP_RETURN, op_return)
+        interp->vm_sp = interp->vm_stack;
+        return;
+
+#ifndef THREADED_DISPATCH
+        default:
+            UNREACHABLE();
+    }
+#endif
+}
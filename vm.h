@@ -0,0 +1,13 @@
+/*! \file
+ * Declarations for the stack VM that runs compiled bytecode.
+ */
+
+#ifndef VM_H
+#define VM_H
+
+#include "eval.h"
+#include "bytecode.h"
+
+void run_code(Interp *interp, Code *code);
+
+#endif /* VM_H */
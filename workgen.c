@@ -0,0 +1,245 @@
+/*! \file
+ * Generates benchmark scripts in the language the parser accepts, in one of
+ * several shapes:
+ *
+ *   nested  deeply nested lists, built and then subscripted all the way down
+ *   wide    dicts with many string keys, read and updated by key
+ *   arith   long arithmetic chains over a handful of globals
+ *   churn   the same few globals rebound to fresh lists and dicts, over and
+ *           over, leaving the old values as garbage
+ *   del     globals bound and then deleted a fixed distance behind
+ *   mixed   all of the above, interleaved
+ *
+ * Every so often a statement is an expression, whose value is printed.
+ *
+ * Usage: workgen [--shape SHAPE] [--statements N] [--depth N] [--width N]
+ *                [--seed N]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! One statement in this many is an expression, printed when run. */
+#define PRINT_EVERY 16
+
+/*! How many globals the churn shape keeps rebinding. */
+#define CHURN_GLOBALS 8
+
+/*! How far behind the newest binding the del shape deletes. */
+#define DEL_DISTANCE 64
+
+typedef struct Params {
+    long statements;
+    /*! Nesting depth of the nested shape's lists. */
+    int depth;
+    /*! Keys per dict, terms per arithmetic chain, and items per list. */
+    int width;
+} Params;
+
+/*! Emits one statement of a shape, the i'th of the script. */
+typedef void (*ShapeFn)(const Params *params, long i);
+
+static void emit_nested(const Params *params, long i) {
+    long n = i / 2;
+
+    if (i % 2 == 0) {
+        printf("nest%ld = ", n % 256);
+        for (int d = 0; d < params->depth; d++) {
+            printf("[%ld, ", n + d);
+        }
+        printf("'leaf'");
+        for (int d = 0; d < params->depth; d++) {
+            printf("]");
+        }
+        printf("\n");
+        return;
+    }
+
+    /* Subscript down to the leaf, or one level short of it. */
+    int levels = i % PRINT_EVERY == 1 ? params->depth : params->depth - 1;
+
+    if (i % PRINT_EVERY != 1) {
+        printf("deepest = ");
+    }
+    printf("nest%ld", n % 256);
+    for (int d = 0; d < levels; d++) {
+        printf("[1]");
+    }
+    printf("\n");
+}
+
+static void emit_wide(const Params *params, long i) {
+    long n = i / 4;
+    int key = (i * 7) % params->width;
+
+    switch (i % 4) {
+        case 0:
+            printf("wide%ld = {", n % 64);
+            for (int k = 0; k < params->width; k++) {
+                printf("%s'key_number_%d': %d", k == 0 ? "" : ", ", k, k);
+            }
+            printf("}\n");
+            break;
+        case 1:
+            printf("wide%ld['key_number_%d'] = 'updated value %ld'\n",
+                   n % 64, key, n);
+            break;
+        case 2:
+            printf("value = wide%ld['key_number_%d']\n", n % 64, key);
+            break;
+        default:
+            if (i % PRINT_EVERY == 3) {
+                printf("wide%ld['key_number_%d']\n", n % 64, key);
+            } else {
+                printf("wide%ld['new_key_%ld'] = [%ld]\n", n % 64, n, n);
+            }
+            break;
+    }
+}
+
+static void emit_arith(const Params *params, long i) {
+    static const char *const ops[] = { " + ", " - ", " * ", " / " };
+
+    if (i < 3) {
+        printf("%c = %ld.5\n", 'x' + (int) i, i + 2);
+        return;
+    }
+
+    if (i % PRINT_EVERY != 0) {
+        printf("r%ld = ", i % 128);
+    }
+    printf("(x + %ld)", i % 97);
+    for (int t = 1; t < params->width; t++) {
+        printf("%s%c", ops[(i + t) % 4], 'x' + (int) ((i + t) % 3));
+        if (t % 4 == 0) {
+            printf(" * (y - %d.25)", t);
+        }
+    }
+    printf("\n");
+}
+
+static void emit_churn(const Params *params, long i) {
+    long g = i % CHURN_GLOBALS;
+
+    if (i % PRINT_EVERY == PRINT_EVERY - 1) {
+        printf("churn%ld\n", g);
+        return;
+    }
+
+    if (i % 2 == 0) {
+        printf("churn%ld = [", g);
+        for (int k = 0; k < params->width; k++) {
+            printf("%s'item %d'", k == 0 ? "" : ", ", k);
+        }
+        printf("]\n");
+    } else {
+        printf("churn%ld = {'index': %ld, 'name': 'value %ld', "
+               "'items': [%ld, %ld]}\n", g, i, i, i, i + 1);
+    }
+}
+
+static void emit_del(const Params *params, long i) {
+    long n = i / 2;
+
+    (void) params;
+    if (i % 2 == 0) {
+        printf("temp%ld = ['short lived', %ld, {'n': %ld}]\n", n, n, n);
+    } else if (n >= DEL_DISTANCE) {
+        printf("del temp%ld\n", n - DEL_DISTANCE);
+    } else if (i % PRINT_EVERY == 1) {
+        printf("temp%ld\n", n);
+    } else {
+        printf("kept%ld = temp%ld\n", n, n);
+    }
+}
+
+typedef struct Shape {
+    const char *name;
+    ShapeFn emit;
+} Shape;
+
+static const Shape shapes[] = {
+    {"nested", emit_nested},
+    {"wide", emit_wide},
+    {"arith", emit_arith},
+    {"churn", emit_churn},
+    {"del", emit_del},
+};
+
+#define NUM_SHAPES ((int) (sizeof(shapes) / sizeof(shapes[0])))
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--shape nested|wide|arith|churn|del|mixed]"
+            " [--statements N]\n       [--depth N] [--width N] [--seed N]\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"shape", required_argument, NULL, 's'},
+        {"statements", required_argument, NULL, 'n'},
+        {"depth", required_argument, NULL, 'd'},
+        {"width", required_argument, NULL, 'w'},
+        {"seed", required_argument, NULL, 'r'},
+        {NULL, 0, NULL, 0}
+    };
+    Params params = { .statements = 10000, .depth = 16, .width = 32 };
+    const char *shape = "mixed";
+    int option;
+
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 's':
+                shape = optarg;
+                break;
+            case 'n':
+                params.statements = atol(optarg);
+                break;
+            case 'd':
+                params.depth = atoi(optarg);
+                break;
+            case 'w':
+                params.width = atoi(optarg);
+                break;
+            case 'r':
+                srand(atoi(optarg));
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc || params.depth < 1 || params.width < 1) {
+        usage(argv[0]);
+    }
+
+    if (strcmp(shape, "mixed") == 0) {
+        /* Runs of a few statements from each shape in turn, in random order,
+         * so each shape's globals are set up before they're used. */
+        long counts[NUM_SHAPES] = { 0 };
+
+        for (long i = 0; i < params.statements; ) {
+            int s = rand() % NUM_SHAPES;
+
+            for (int run = 0; run < 8 && i < params.statements; run++, i++) {
+                shapes[s].emit(&params, counts[s]++);
+            }
+        }
+        return 0;
+    }
+
+    for (int s = 0; s < NUM_SHAPES; s++) {
+        if (strcmp(shape, shapes[s].name) == 0) {
+            for (long i = 0; i < params.statements; i++) {
+                shapes[s].emit(&params, i);
+            }
+            return 0;
+        }
+    }
+
+    usage(argv[0]);
+    return 2;
+}